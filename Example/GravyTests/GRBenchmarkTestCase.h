@@ -0,0 +1,30 @@
+//
+//  GRBenchmarkTestCase.h
+//  Gravy
+//
+//  Created by Nathan Tesler on 30/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+/* GRBenchmarkTestCase is the superclass of the benchmarks. It times blocks of work and logs the results, so they can be compared from one change to the next. Benchmarks run with the other tests, and only fail if the work they measure goes wrong. */
+@interface GRBenchmarkTestCase : SenTestCase
+
+/* Runs the block once and logs how long it took, and how many operations per second that is.
+ @param name What's being measured, for the log
+ @param count The number of operations the block performs
+ @return The time the block took, in seconds
+ */
+-(NSTimeInterval)measure:(NSString *)name count:(NSUInteger)count block:(void (^)(void))block;
+
+/* Logs a duration measured elsewhere (eg. one reported by the code being benchmarked) like `-measure:count:block:` does. */
+-(void)report:(NSString *)name duration:(NSTimeInterval)duration count:(NSUInteger)count;
+
+/* Runs the block once and logs the most memory the process used while it ran, over what it used before.
+ @param name What's being measured, for the log
+ @return The peak growth in resident memory, in bytes
+ */
+-(unsigned long long)measurePeakMemory:(NSString *)name block:(void (^)(void))block;
+
+@end
@@ -0,0 +1,76 @@
+//
+//  GRBenchmarkTestCase.m
+//  Gravy
+//
+//  Created by Nathan Tesler on 30/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import "GRBenchmarkTestCase.h"
+#include <mach/mach.h>
+
+// How often memory is sampled while a block runs
+static uint64_t const GRBenchmarkMemorySampleInterval = NSEC_PER_MSEC;
+
+static unsigned long long GRBenchmarkResidentMemory(void);
+
+@implementation GRBenchmarkTestCase
+
+-(NSTimeInterval)measure:(NSString *)name count:(NSUInteger)count block:(void (^)(void))block
+{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    @autoreleasepool {
+        block();
+    }
+    NSTimeInterval duration = CFAbsoluteTimeGetCurrent() - startTime;
+
+    [self report:name duration:duration count:count];
+
+    return duration;
+}
+
+-(void)report:(NSString *)name duration:(NSTimeInterval)duration count:(NSUInteger)count
+{
+    NSLog(@"%@: %@: %.3fs for %lu (%.0f/s)", NSStringFromClass([self class]), name, duration, (unsigned long)count, duration > 0 ? count / duration : 0);
+}
+
+-(unsigned long long)measurePeakMemory:(NSString *)name block:(void (^)(void))block
+{
+    // Sample the resident size on another queue while the block runs
+    unsigned long long startMemory        = GRBenchmarkResidentMemory();
+    __block unsigned long long peakMemory = startMemory;
+    dispatch_queue_t queue                = dispatch_queue_create("org.thegravytrain.benchmark.memory", NULL);
+    dispatch_source_t timer               = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, 0), GRBenchmarkMemorySampleInterval, 0);
+    dispatch_source_set_event_handler(timer, ^{
+        peakMemory = MAX(peakMemory, GRBenchmarkResidentMemory());
+    });
+    dispatch_resume(timer);
+
+    @autoreleasepool {
+        block();
+    }
+
+    // Take a last sample once the timer has stopped, so the peak isn't read while it's being written
+    dispatch_source_cancel(timer);
+    dispatch_sync(queue, ^{
+        peakMemory = MAX(peakMemory, GRBenchmarkResidentMemory());
+    });
+    unsigned long long growth = peakMemory - startMemory;
+
+    NSLog(@"%@: %@: peak %.1f MB over %.1f MB", NSStringFromClass([self class]), name, growth / 1048576.0, startMemory / 1048576.0);
+
+    return growth;
+}
+
+@end
+
+static unsigned long long GRBenchmarkResidentMemory(void)
+{
+    struct task_basic_info info;
+    mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+
+    return info.resident_size;
+}
@@ -0,0 +1,169 @@
+//
+//  GRLocalSourceBenchmarks.m
+//  Gravy
+//
+//  Created by Nathan Tesler on 31/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import "GRBenchmarkTestCase.h"
+
+/* The benchmarks simulate a relaunch by dropping the source from the registry, so the next call to +source creates a new one that loads from disk. */
+@interface GRSource (LocalSourceBenchmarks)
++(NSMutableDictionary *)sources;
+@end
+
+@interface GRBenchmarkStoredRecord : GRObject
+@property (strong, nonatomic) NSString *title;
+@property (nonatomic) NSInteger position;
+@property (nonatomic) double rating;
+@property (strong, nonatomic) NSDate *publishDate;
+@property (strong, nonatomic) NSArray *tags;
+@end
+
+@implementation GRBenchmarkStoredRecord
+
++(id)source
+{
+    return [GRLocalSource source:self];
+}
+
+@end
+
+@interface GRLocalSourceBenchmarks : GRBenchmarkTestCase
+@end
+
+@implementation GRLocalSourceBenchmarks
+
+#pragma mark - Helpers
+
+-(NSString *)pathWithExtension:(NSString *)extension
+{
+    NSString *dataPath = [[NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"Data"];
+    return [[dataPath stringByAppendingPathComponent:NSStringFromClass([GRBenchmarkStoredRecord class])] stringByAppendingPathExtension:extension];
+}
+
+-(void)removeStore
+{
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    for (NSString *extension in @[ @"json", @"store", @"journal", @"json.tmp", @"store.tmp" ])
+        [fileManager removeItemAtPath:[self pathWithExtension:extension] error:nil];
+}
+
+-(GRLocalSource *)relaunchWithFormat:(GRLocalSourceStoreFormat)format
+{
+    // Nothing else uses the registry while a benchmark runs
+    [[GRSource sources] removeObjectForKey:[GRBenchmarkStoredRecord class]];
+
+    // Only commit when the benchmark says so
+    GRLocalSource *source        = [GRBenchmarkStoredRecord source];
+    source.commitChangeCount     = 0;
+    source.commitIdleInterval    = 0;
+    source.minimumCommitInterval = 0;
+    source.maximumCommitLatency  = 0;
+
+    // The source reads whichever store it finds, so this only commits (an empty store) the first time
+    source.storeFormat = format;
+
+    return source;
+}
+
+-(void)commitSource:(GRLocalSource *)source expectingType:(GRLocalSourceCommitType)type objectCount:(NSUInteger)objectCount
+{
+    [source commit];
+
+    // Metrics are set on the main queue once the write has finished. Earlier commits (like the one that sets the format) are written first.
+    NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:60];
+    while ((source.lastCommitType != type || source.lastCommitObjectCount != objectCount) && [timeout timeIntervalSinceNow] > 0)
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+
+    STAssertEquals(source.lastCommitType, type, @"The commit wasn't written");
+    STAssertEquals(source.lastCommitObjectCount, objectCount, nil);
+}
+
+-(GRLocalSource *)sourceWithStoredRecordCount:(NSUInteger)count format:(GRLocalSourceStoreFormat)format
+{
+    GRLocalSource *source = [self relaunchWithFormat:format];
+    [source performBatchUpdates:^{
+        for (NSUInteger i = 0; i < count; i++)
+        {
+            GRBenchmarkStoredRecord *record = [[GRBenchmarkStoredRecord alloc] init];
+            record.title       = [NSString stringWithFormat:@"Record %lu", (unsigned long)i];
+            record.position    = i;
+            record.rating      = i / 7.0;
+            record.publishDate = [NSDate dateWithTimeIntervalSince1970:1359600000 + i * 60];
+            record.tags        = @[ @"one", @"two", @"three" ];
+            [record save];
+        }
+    }];
+
+    // So many inserts are written as a new store file rather than to the journal
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeStore objectCount:count];
+
+    return source;
+}
+
+#pragma mark - Setup
+
+-(void)setUp
+{
+    [super setUp];
+    [self removeStore];
+}
+
+-(void)tearDown
+{
+    [[GRSource sources] removeObjectForKey:[GRBenchmarkStoredRecord class]];
+    [self removeStore];
+
+    [super tearDown];
+}
+
+#pragma mark - Benchmarks
+
+-(void)testLoadAndSave
+{
+    // The same store saved and loaded in each format. Reading every record's title fires any faults, so lazily loaded stores are compared fairly.
+    NSUInteger const recordCount = 20000;
+    for (NSNumber *format in @[ @(GRLocalSourceStoreFormatJSON), @(GRLocalSourceStoreFormatBinary) ])
+    {
+        NSString *formatName  = [format integerValue] == GRLocalSourceStoreFormatBinary ? @"binary" : @"JSON";
+        GRLocalSource *source = [self sourceWithStoredRecordCount:recordCount format:[format integerValue]];
+        [self report:[NSString stringWithFormat:@"save (%@, %lu bytes)", formatName, (unsigned long)source.lastCommitByteCount] duration:source.lastCommitDuration count:recordCount];
+
+        __block NSUInteger loaded = 0;
+        [self measure:[NSString stringWithFormat:@"load (%@)", formatName] count:recordCount block:^{
+            for (GRBenchmarkStoredRecord *record in [self relaunchWithFormat:[format integerValue]].objects)
+                if (record.title)
+                    loaded++;
+        }];
+        STAssertEquals(loaded, recordCount, nil);
+
+        [self removeStore];
+    }
+}
+
+-(void)testCommitLatency
+{
+    // Changing one object appends it to the journal, so the commit should take about as long whatever the size of the store
+    for (NSNumber *recordCount in @[ @1000, @10000, @50000 ])
+    {
+        for (NSNumber *format in @[ @(GRLocalSourceStoreFormatJSON), @(GRLocalSourceStoreFormatBinary) ])
+        {
+            NSString *name        = [NSString stringWithFormat:@"%@ store of %@", [format integerValue] == GRLocalSourceStoreFormatBinary ? @"binary" : @"JSON", recordCount];
+            GRLocalSource *source = [self sourceWithStoredRecordCount:[recordCount unsignedIntegerValue] format:[format integerValue]];
+            [self report:[NSString stringWithFormat:@"store rewrite (%@)", name] duration:source.lastCommitDuration count:[recordCount unsignedIntegerValue]];
+
+            GRBenchmarkStoredRecord *record = [source.objects lastObject];
+            record.title = @"Changed";
+            [self commitSource:source expectingType:GRLocalSourceCommitTypeJournal objectCount:1];
+            [self report:[NSString stringWithFormat:@"commit of 1 change (%@, %lu bytes)", name, (unsigned long)source.lastCommitByteCount] duration:source.lastCommitDuration count:1];
+
+            GRLocalSource *relaunchedSource = [self relaunchWithFormat:[format integerValue]];
+            STAssertEqualObjects([[relaunchedSource objectWithUniqueIdentifier:record.uniqueIdentifier] title], @"Changed", nil);
+            [self removeStore];
+        }
+    }
+}
+
+@end
@@ -0,0 +1,206 @@
+//
+//  GRLocalSourceCrashRecoveryTests.m
+//  Gravy
+//
+//  Created by Nathan Tesler on 30/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+#include <sys/stat.h>
+
+/* The tests simulate a relaunch by dropping the source from the registry, so the next call to +source creates a new one that loads from disk. */
+@interface GRSource (CrashRecoveryTests)
++(NSMutableDictionary *)sources;
+@end
+
+@interface GRCrashRecoveryRecord : GRObject
+@property (strong, nonatomic) NSString *name;
+@end
+
+@implementation GRCrashRecoveryRecord
+
++(id)source
+{
+    return [GRLocalSource source:self];
+}
+
+@end
+
+@interface GRLocalSourceCrashRecoveryTests : SenTestCase
+@end
+
+@implementation GRLocalSourceCrashRecoveryTests
+
+#pragma mark - Helpers
+
+-(NSString *)dataPath
+{
+    return [[NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"Data"];
+}
+
+-(NSString *)pathWithExtension:(NSString *)extension
+{
+    return [[[self dataPath] stringByAppendingPathComponent:NSStringFromClass([GRCrashRecoveryRecord class])] stringByAppendingPathExtension:extension];
+}
+
+-(GRLocalSource *)relaunch
+{
+    // Nothing else uses the registry while a test runs
+    [[GRSource sources] removeObjectForKey:[GRCrashRecoveryRecord class]];
+
+    // Only commit when the test says so
+    GRLocalSource *source        = [GRCrashRecoveryRecord source];
+    source.commitChangeCount     = 0;
+    source.commitIdleInterval    = 0;
+    source.minimumCommitInterval = 0;
+    source.maximumCommitLatency  = 0;
+
+    return source;
+}
+
+-(void)commitSource:(GRLocalSource *)source expectingType:(GRLocalSourceCommitType)type
+{
+    [source commit];
+
+    // Metrics are set on the main queue once the write has finished
+    NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+    while (source.lastCommitType != type && [timeout timeIntervalSinceNow] > 0)
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+
+    STAssertEquals(source.lastCommitType, type, @"The commit wasn't written");
+}
+
+-(GRLocalSource *)sourceWithJournaledRecordNamed:(NSString *)name
+{
+    GRLocalSource *source = [self relaunch];
+
+    GRCrashRecoveryRecord *record = [[GRCrashRecoveryRecord alloc] init];
+    record.name = name;
+    [record save];
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeJournal];
+
+    return source;
+}
+
+-(unsigned long long)sizeOfFileAtPath:(NSString *)path
+{
+    return [[[[NSFileManager alloc] init] attributesOfItemAtPath:path error:nil] fileSize];
+}
+
+#pragma mark - Setup
+
+-(void)setUp
+{
+    [super setUp];
+
+    // Start every test from an empty store
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    for (NSString *extension in @[ @"json", @"store", @"journal", @"json.tmp", @"store.tmp" ])
+        [fileManager removeItemAtPath:[self pathWithExtension:extension] error:nil];
+    [fileManager removeItemAtPath:[[self pathWithExtension:@"json"] stringByDeletingPathExtension] error:nil];
+}
+
+#pragma mark - Tests
+
+-(void)testTornJournalEntryIsDropped
+{
+    [self sourceWithJournaledRecordNamed:@"Saved"];
+    NSString *journalPath         = [self pathWithExtension:@"journal"];
+    unsigned long long goodLength = [self sizeOfFileAtPath:journalPath];
+
+    // A crash while appending leaves the start of an entry: a length promising more bytes than follow, and a checksum that doesn't match them
+    NSFileHandle *journal = [NSFileHandle fileHandleForWritingAtPath:journalPath];
+    [journal seekToEndOfFile];
+    uint32_t tornEntry[4] = { CFSwapInt32HostToLittle(100), CFSwapInt32HostToLittle(0xdeadbeef), 1, 2 };
+    [journal writeData:[NSData dataWithBytes:tornEntry length:sizeof(tornEntry)]];
+    [journal closeFile];
+
+    GRLocalSource *source = [self relaunch];
+    STAssertEquals([source.objects count], (NSUInteger)1, @"The entry before the torn one should be replayed");
+    STAssertEqualObjects([[source.objects lastObject] name], @"Saved", nil);
+    STAssertEquals([self sizeOfFileAtPath:journalPath], goodLength, @"The torn entry should be cut off the journal");
+
+    // Later entries go after the last good one, and are replayed
+    GRCrashRecoveryRecord *record = [[GRCrashRecoveryRecord alloc] init];
+    record.name = @"After";
+    [record save];
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeJournal];
+
+    STAssertEquals([[self relaunch].objects count], (NSUInteger)2, nil);
+}
+
+-(void)testJournalForEarlierStoreIsIgnored
+{
+    [self sourceWithJournaledRecordNamed:@"Compacted"];
+    NSString *journalPath = [self pathWithExtension:@"journal"];
+
+    // A crash between replacing the store and removing the journal leaves a journal that names the old store file's inode
+    struct stat storeStat;
+    STAssertEquals(stat([[self pathWithExtension:@"json"] fileSystemRepresentation], &storeStat), 0, nil);
+    uint64_t staleInode = CFSwapInt64HostToLittle((uint64_t)storeStat.st_ino + 1);
+
+    NSFileHandle *journal = [NSFileHandle fileHandleForWritingAtPath:journalPath];
+    [journal seekToFileOffset:4];
+    [journal writeData:[NSData dataWithBytes:&staleInode length:sizeof(staleInode)]];
+    [journal closeFile];
+
+    GRLocalSource *source = [self relaunch];
+    STAssertEquals([source.objects count], (NSUInteger)0, @"A journal for another store file shouldn't be replayed");
+    STAssertFalse([[[NSFileManager alloc] init] fileExistsAtPath:journalPath], @"A journal for another store file should be removed");
+}
+
+-(void)testPartialStoreWriteIsIgnored
+{
+    GRLocalSource *source = [self sourceWithJournaledRecordNamed:@"Kept"];
+
+    // Compact the journal into the store, then leave a half written replacement behind, as a crash while writing the store would
+    source.storeFormat = GRLocalSourceStoreFormatBinary;
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeStore];
+    [[NSData dataWithBytes:"GRB" length:3] writeToFile:[self pathWithExtension:@"store.tmp"] atomically:NO];
+
+    source = [self relaunch];
+    STAssertEquals([source.objects count], (NSUInteger)1, nil);
+    STAssertEqualObjects([[source.objects lastObject] name], @"Kept", nil);
+    STAssertNil(source.loadError, nil);
+}
+
+-(void)testRemovedObjectChangesArentCommitted
+{
+    GRLocalSource *source = [self sourceWithJournaledRecordNamed:@"Removed"];
+    source.storeFormat    = GRLocalSourceStoreFormatBinary;
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeStore];
+
+    // A removed object still tells the source about its changes, which mustn't bring it back
+    GRCrashRecoveryRecord *record = [source.objects lastObject];
+    [record remove];
+    record.name = @"Changed after removal";
+    STAssertEquals(source.dirtyObjectCount, (NSUInteger)0, nil);
+    STAssertEquals(source.deletedObjectCount, (NSUInteger)1, nil);
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeJournal];
+
+    STAssertEquals([[self relaunch].objects count], (NSUInteger)0, @"The removed object shouldn't be replayed");
+}
+
+-(void)testUnsavedObjectChangesArentCommitted
+{
+    GRLocalSource *source = [self sourceWithJournaledRecordNamed:@"Saved"];
+    source.storeFormat    = GRLocalSourceStoreFormatBinary;
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeStore];
+
+    // Changing an object that was never saved doesn't register it
+    GRCrashRecoveryRecord *record = [[GRCrashRecoveryRecord alloc] init];
+    record.name = @"Unsaved";
+    STAssertEquals(source.dirtyObjectCount, (NSUInteger)0, nil);
+
+    // Anything else that's committed mustn't take the unsaved object along with it
+    GRCrashRecoveryRecord *saved = [source.objects lastObject];
+    saved.name = @"Changed";
+    [self commitSource:source expectingType:GRLocalSourceCommitTypeJournal];
+
+    source = [self relaunch];
+    STAssertEquals([source.objects count], (NSUInteger)1, @"The unsaved object shouldn't be replayed");
+    STAssertEqualObjects([[source.objects lastObject] name], @"Changed", nil);
+}
+
+@end
@@ -0,0 +1,224 @@
+//
+//  GRSerializationBenchmarks.m
+//  Gravy
+//
+//  Created by Nathan Tesler on 31/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import "GRBenchmarkTestCase.h"
+
+@interface GRBenchmarkRecord : GRObject
+@property (strong, nonatomic) NSString *title;
+@property (nonatomic) NSInteger position;
+@property (nonatomic) double rating;
+@property (nonatomic) BOOL published;
+@property (strong, nonatomic) NSDate *publishDate;
+@property (strong, nonatomic) NSArray *tags;
+@end
+
+@implementation GRBenchmarkRecord
+
++(id)source
+{
+    return [GRSource source:self];
+}
+
+@end
+
+/* GRSerialization's private case and date conversion, which every key and date of every payload goes through. */
+@interface GRSerialization (Benchmarks)
++(NSString *)convertString:(NSString *)string toCase:(GRSerializationCase)serializationCase;
++(NSString *)stringWithDate:(NSDate *)date options:(NSDictionary *)options;
++(NSDate *)dateWithString:(NSString *)string options:(NSDictionary *)options;
+@end
+
+@interface GRSerializationBenchmarks : GRBenchmarkTestCase
+@end
+
+@implementation GRSerializationBenchmarks
+
+#pragma mark - Helpers
+
+-(NSArray *)recordsWithCount:(NSUInteger)count
+{
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        GRBenchmarkRecord *record = [[GRBenchmarkRecord alloc] init];
+        record.title       = [NSString stringWithFormat:@"Record %lu", (unsigned long)i];
+        record.position    = i;
+        record.rating      = i / 7.0;
+        record.published   = i % 2;
+        record.publishDate = [NSDate dateWithTimeIntervalSince1970:1359600000 + i * 60];
+        record.tags        = @[ @"one", @"two", @"three" ];
+        [records addObject:record];
+    }
+
+    return records;
+}
+
+#pragma mark - Benchmarks
+
+-(void)testDeserialization
+{
+    // Each object needs its class' properties and their types, which are looked up once per class rather than once per object
+    NSUInteger const recordCount = 10000;
+    NSData *JSON                 = [GRSerialization JSONWithObject:[self recordsWithCount:recordCount] options:nil];
+
+    __block NSArray *records;
+    [self measure:@"deserialization" count:recordCount block:^{
+        records = [GRSerialization objectWithJSON:JSON class:[GRBenchmarkRecord class] options:nil];
+    }];
+
+    STAssertEquals([records count], recordCount, nil);
+    STAssertEqualObjects([[records lastObject] title], ([NSString stringWithFormat:@"Record %lu", (unsigned long)(recordCount - 1)]), nil);
+    STAssertEquals([(GRBenchmarkRecord *)[records lastObject] position], (NSInteger)(recordCount - 1), nil);
+}
+
+-(void)testPayloadClassInference
+{
+    // A corpus of API responses, whose keys name the class of their values. The class for each key is only inferred once.
+    NSUInteger const payloadCount = 1000;
+    NSArray *records              = [NSJSONSerialization JSONObjectWithData:[GRSerialization JSONWithObject:[self recordsWithCount:4] options:nil] options:0 error:nil];
+    NSMutableArray *payloads      = [NSMutableArray arrayWithCapacity:payloadCount];
+    for (NSUInteger i = 0; i < payloadCount; i++)
+    {
+        NSDictionary *payload = @{ @"benchmarkRecords": [records subarrayWithRange:NSMakeRange(0, 3)], @"benchmarkRecord": records[3] };
+        [payloads addObject:[NSJSONSerialization dataWithJSONObject:payload options:0 error:nil]];
+    }
+
+    [GRSerialization resetInferredPayloadClasses];
+    __block NSDictionary *objects;
+    [self measure:@"payload class inference" count:payloadCount block:^{
+        for (NSData *payload in payloads)
+            objects = [GRSerialization objectWithJSON:payload class:[GRObject class] options:nil];
+    }];
+
+    STAssertEquals([objects[@"benchmarkRecords"] count], (NSUInteger)3, nil);
+    STAssertTrue([[objects[@"benchmarkRecords"] lastObject] isKindOfClass:[GRBenchmarkRecord class]], nil);
+    STAssertTrue([objects[@"benchmarkRecord"] isKindOfClass:[GRBenchmarkRecord class]], nil);
+}
+
+-(void)testKeyConversion
+{
+    // APIs use a small, fixed set of keys, converted back and forth for every object
+    NSUInteger const conversionCount = 1000000;
+    NSArray *llamaKeys = @[ @"uniqueIdentifier", @"creationDate", @"updateDate", @"title", @"publishDate", @"authorIdentifier", @"commentCount", @"isPublished", @"thumbnailURL", @"lastReadPosition" ];
+    NSMutableArray *snakeKeys = [NSMutableArray arrayWithCapacity:[llamaKeys count]];
+    for (NSString *key in llamaKeys)
+        [snakeKeys addObject:[GRSerialization convertString:key toCase:GRSerializationCaseSnakeCase]];
+
+    __block NSUInteger converted = 0;
+    [self measure:@"key conversion" count:conversionCount block:^{
+        for (NSUInteger i = 0; i < conversionCount / 2; i++)
+        {
+            if ([GRSerialization convertString:llamaKeys[i % [llamaKeys count]] toCase:GRSerializationCaseSnakeCase])
+                converted++;
+            if ([GRSerialization convertString:snakeKeys[i % [snakeKeys count]] toCase:GRSerializationCaseLlamaCase])
+                converted++;
+        }
+    }];
+
+    STAssertEquals(converted, conversionCount, nil);
+    STAssertEqualObjects(snakeKeys[5], @"author_id", nil);
+    STAssertEqualObjects([GRSerialization convertString:@"author_id" toCase:GRSerializationCaseLlamaCase], @"authorIdentifier", nil);
+}
+
+-(void)testStreamingWriteMemory
+{
+    // Written to a file as it's generated, the JSON for 100k records shouldn't take more memory than the records do already
+    NSUInteger const recordCount = 100000;
+    NSArray *records             = [self recordsWithCount:recordCount];
+    NSString *path               = [NSTemporaryDirectory() stringByAppendingPathComponent:@"GRSerializationBenchmarks.json"];
+    NSOutputStream *stream       = [NSOutputStream outputStreamToFileAtPath:path append:NO];
+
+    __block BOOL written;
+    unsigned long long streamingGrowth = [self measurePeakMemory:@"streaming JSON write of 100k objects" block:^{
+        written = [GRSerialization writeJSONWithObject:records toStream:stream options:nil];
+    }];
+    [stream close];
+
+    unsigned long long fileSize = [[[[NSFileManager alloc] init] attributesOfItemAtPath:path error:nil] fileSize];
+    [[[NSFileManager alloc] init] removeItemAtPath:path error:nil];
+    STAssertTrue(written, nil);
+    STAssertTrue(streamingGrowth < fileSize, @"Streaming %llu bytes of JSON took %llu bytes of memory", fileSize, streamingGrowth);
+
+    // For comparison, the same JSON built in memory
+    __block NSData *JSON;
+    [self measurePeakMemory:@"in-memory JSON of 100k objects" block:^{
+        JSON = [GRSerialization JSONWithObject:records options:nil];
+    }];
+    STAssertEquals((unsigned long long)[JSON length], fileSize, nil);
+}
+
+-(void)testNumberSerialization
+{
+    // Every number is normalized before it's written. Numbers already of a supported type are written as they are, without being boxed again.
+    NSUInteger const numberCount = 1000000;
+    NSMutableArray *numbers      = [NSMutableArray arrayWithCapacity:numberCount];
+    for (NSUInteger i = 0; i < numberCount; i++)
+    {
+        switch (i % 4)
+        {
+            case 0: [numbers addObject:@((NSInteger)i)];  break;
+            case 1: [numbers addObject:@((NSUInteger)i)]; break;
+            case 2: [numbers addObject:@(i / 4.0)];       break;
+            case 3: [numbers addObject:@((BOOL)(i % 2))]; break;
+        }
+    }
+
+    __block NSData *JSON;
+    [self measure:@"number serialization" count:numberCount block:^{
+        JSON = [GRSerialization JSONWithObject:numbers options:nil];
+    }];
+    [self measurePeakMemory:@"JSON of 1M numbers" block:^{
+        JSON = [GRSerialization JSONWithObject:numbers options:nil];
+    }];
+
+    NSArray *readNumbers = [NSJSONSerialization JSONObjectWithData:JSON options:0 error:nil];
+    STAssertEquals([readNumbers count], numberCount, nil);
+    STAssertEqualObjects(readNumbers[numberCount - 2], @((numberCount - 2) / 4.0), nil);
+    STAssertEqualObjects(readNumbers[numberCount - 1], @YES, nil);
+}
+
+-(void)testDateConversion
+{
+    // Every object has at least a creation and update date, written and read as ISO 8601 strings. For comparison, the same with an NSDateFormatter.
+    NSUInteger const dateCount = 100000;
+    NSMutableArray *dates      = [NSMutableArray arrayWithCapacity:dateCount];
+    for (NSUInteger i = 0; i < dateCount; i++)
+        [dates addObject:[NSDate dateWithTimeIntervalSince1970:1359600000 + i * 61]];
+
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale           = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone         = [NSTimeZone timeZoneWithName:@"UTC"];
+    formatter.dateFormat       = @"yyyy-MM-dd'T'HH:mm:ss'Z'";
+
+    NSMutableArray *strings          = [NSMutableArray arrayWithCapacity:dateCount];
+    NSMutableArray *formattedStrings = [NSMutableArray arrayWithCapacity:dateCount];
+    [self measure:@"date formatting" count:dateCount block:^{
+        for (NSDate *date in dates)
+            [strings addObject:[GRSerialization stringWithDate:date options:nil]];
+    }];
+    [self measure:@"date formatting (NSDateFormatter)" count:dateCount block:^{
+        for (NSDate *date in dates)
+            [formattedStrings addObject:[formatter stringFromDate:date]];
+    }];
+    STAssertEqualObjects(strings, formattedStrings, nil);
+
+    NSMutableArray *parsedDates          = [NSMutableArray arrayWithCapacity:dateCount];
+    NSMutableArray *formatterParsedDates = [NSMutableArray arrayWithCapacity:dateCount];
+    [self measure:@"date parsing" count:dateCount block:^{
+        for (NSString *string in strings)
+            [parsedDates addObject:[GRSerialization dateWithString:string options:nil]];
+    }];
+    [self measure:@"date parsing (NSDateFormatter)" count:dateCount block:^{
+        for (NSString *string in strings)
+            [formatterParsedDates addObject:[formatter dateFromString:string]];
+    }];
+    STAssertEqualObjects(parsedDates, dates, nil);
+    STAssertEqualObjects(formatterParsedDates, dates, nil);
+}
+
+@end
@@ -0,0 +1,258 @@
+//
+//  GRSerializationTests.m
+//  Gravy
+//
+//  Created by Nathan Tesler on 31/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface GRSerializationTestRecord : GRObject
+@property (strong, nonatomic) NSString *title;
+@property (nonatomic) NSInteger position;
+@property (nonatomic) double rating;
+@property (nonatomic) BOOL published;
+@property (strong, nonatomic) NSDate *publishDate;
+@property (strong, nonatomic) NSData *attachment;
+@property (strong, nonatomic) NSArray *tags;
+@property (strong, nonatomic) NSDictionary *info;
+@end
+
+@implementation GRSerializationTestRecord
+
++(id)source
+{
+    return [GRSource source:self];
+}
+
+@end
+
+/* GRSerialization's private date conversion, which every date property goes through. */
+@interface GRSerialization (Tests)
++(NSString *)stringWithDate:(NSDate *)date options:(NSDictionary *)options;
++(NSDate *)dateWithString:(NSString *)string options:(NSDictionary *)options;
+@end
+
+@interface GRSerializationTests : SenTestCase
+@end
+
+@implementation GRSerializationTests
+
+#pragma mark - Helpers
+
+-(NSArray *)records
+{
+    // Strings that need escaping, numbers of each kind, empty and nil values. Dates are whole seconds, as that's what JSON keeps.
+    GRSerializationTestRecord *escaped = [[GRSerializationTestRecord alloc] init];
+    escaped.title       = @"Line\nbreak, \"quotes\", \\backslash\\ and \t tab";
+    escaped.position    = -42;
+    escaped.rating      = 0.1;
+    escaped.published   = YES;
+    escaped.publishDate = [NSDate dateWithTimeIntervalSince1970:1359600000];
+    escaped.attachment  = [@"attached" dataUsingEncoding:NSUTF8StringEncoding];
+    escaped.tags        = @[ @"one", @2, @YES ];
+    escaped.info        = @{ @"nested": @{ @"array": @[ @1, @2 ] } };
+
+    GRSerializationTestRecord *unicode = [[GRSerializationTestRecord alloc] init];
+    unicode.title       = @"Crème brûlée ☕ \U0001F370";
+    unicode.position    = NSIntegerMax;
+    unicode.rating      = -1e100;
+    unicode.publishDate = [NSDate dateWithTimeIntervalSince1970:-86400 * 365];
+    unicode.tags        = @[];
+    unicode.info        = @{};
+
+    GRSerializationTestRecord *empty = [[GRSerializationTestRecord alloc] init];
+
+    return @[ escaped, unicode, empty ];
+}
+
+-(void)assertRecords:(NSArray *)records equalRecords:(NSArray *)expectedRecords
+{
+    STAssertEquals([records count], [expectedRecords count], nil);
+    [expectedRecords enumerateObjectsUsingBlock:^(GRSerializationTestRecord *expected, NSUInteger i, BOOL *stop) {
+        if (i >= [records count])
+            return;
+
+        GRSerializationTestRecord *record = records[i];
+        STAssertTrue([record isKindOfClass:[GRSerializationTestRecord class]], nil);
+        STAssertEqualObjects(record.uniqueIdentifier, expected.uniqueIdentifier, nil);
+        STAssertEqualObjects(record.title, expected.title, nil);
+        STAssertEquals(record.position, expected.position, nil);
+        STAssertEquals(record.rating, expected.rating, nil);
+        STAssertEquals(record.published, expected.published, nil);
+        STAssertEqualObjects(record.publishDate, expected.publishDate, nil);
+        STAssertEqualObjects(record.attachment, expected.attachment, nil);
+        STAssertEqualObjects(record.tags, expected.tags, nil);
+        STAssertEqualObjects(record.info, expected.info, nil);
+    }];
+}
+
+-(NSArray *)objectsWithJSONStream:(NSData *)JSON class:(Class)class succeeded:(BOOL *)succeeded
+{
+    NSMutableArray *objects = [NSMutableArray array];
+    NSInputStream *stream   = [NSInputStream inputStreamWithData:JSON];
+    BOOL read = [GRSerialization enumerateObjectsWithJSONStream:stream class:class options:nil usingBlock:^(id object, BOOL *stop) {
+        [objects addObject:object];
+    }];
+    [stream close];
+
+    if (succeeded)
+        *succeeded = read;
+
+    return objects;
+}
+
+#pragma mark - Streaming JSON
+
+-(void)testStreamingJSONRoundTrip
+{
+    NSArray *records       = [self records];
+    NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+    STAssertTrue([GRSerialization writeJSONWithObject:records toStream:stream options:nil], nil);
+    NSData *JSON = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    [stream close];
+
+    // The streamed JSON is valid JSON, and reads back as the same objects
+    STAssertNotNil([NSJSONSerialization JSONObjectWithData:JSON options:0 error:nil], nil);
+
+    BOOL read;
+    NSArray *readRecords = [self objectsWithJSONStream:JSON class:[GRSerializationTestRecord class] succeeded:&read];
+    STAssertTrue(read, nil);
+    [self assertRecords:readRecords equalRecords:records];
+    [self assertRecords:[GRSerialization objectWithJSON:JSON class:[GRSerializationTestRecord class] options:nil] equalRecords:records];
+}
+
+-(void)testStreamingJSONReaderReadsSingleObjectsAndPayloads
+{
+    GRSerializationTestRecord *record = [[self records] objectAtIndex:0];
+    NSData *JSON                      = [GRSerialization JSONWithObject:record options:nil];
+    [self assertRecords:[self objectsWithJSONStream:JSON class:[GRSerializationTestRecord class] succeeded:NULL] equalRecords:@[ record ]];
+
+    // Payload keys name the class of their values
+    NSMutableData *payload = [NSMutableData dataWithData:[@"{\"serializationTestRecords\":" dataUsingEncoding:NSUTF8StringEncoding]];
+    [payload appendData:[GRSerialization JSONWithObject:@[ record ] options:nil]];
+    [payload appendData:[@"}" dataUsingEncoding:NSUTF8StringEncoding]];
+    [self assertRecords:[self objectsWithJSONStream:payload class:[GRObject class] succeeded:NULL] equalRecords:@[ record ]];
+}
+
+-(void)testStreamingJSONReaderStopsAtInvalidJSON
+{
+    // The objects before the problem have already been read
+    NSData *JSON = [@"[{\"title\": \"Complete\"}, {\"title\": \"Trunc" dataUsingEncoding:NSUTF8StringEncoding];
+    BOOL read;
+    NSArray *records = [self objectsWithJSONStream:JSON class:[GRSerializationTestRecord class] succeeded:&read];
+    STAssertFalse(read, nil);
+    STAssertEquals([records count], (NSUInteger)1, nil);
+    STAssertEqualObjects([[records lastObject] title], @"Complete", nil);
+
+    // So is trailing garbage after the top-level value
+    [self objectsWithJSONStream:[@"[] []" dataUsingEncoding:NSUTF8StringEncoding] class:[GRSerializationTestRecord class] succeeded:&read];
+    STAssertFalse(read, nil);
+}
+
+-(void)testStreamingJSONReaderCanStop
+{
+    NSInputStream *stream = [NSInputStream inputStreamWithData:[GRSerialization JSONWithObject:[self records] options:nil]];
+    __block NSUInteger count = 0;
+    BOOL read = [GRSerialization enumerateObjectsWithJSONStream:stream class:[GRSerializationTestRecord class] options:nil usingBlock:^(id object, BOOL *stop) {
+        count++;
+        *stop = YES;
+    }];
+    [stream close];
+
+    STAssertTrue(read, nil);
+    STAssertEquals(count, (NSUInteger)1, nil);
+}
+
+#pragma mark - Binary
+
+-(void)testBinaryRoundTrip
+{
+    // Binary stores keep dates to the fraction of a second and data as raw bytes, rather than converting them to strings
+    NSArray *records                  = [self records];
+    GRSerializationTestRecord *record = records[0];
+    uint8_t bytes[]                   = { 0x00, 0xff, 0xfe, 0x80 };
+    record.publishDate                = [NSDate dateWithTimeIntervalSince1970:1359635696.25];
+    record.attachment                 = [NSData dataWithBytes:bytes length:sizeof(bytes)];
+
+    NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+    STAssertTrue([GRSerialization writeBinaryWithObjects:records class:[GRSerializationTestRecord class] toStream:stream options:nil], nil);
+    NSData *binary = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    [stream close];
+
+    // Read as a stream
+    NSMutableArray *readRecords = [NSMutableArray array];
+    NSInputStream *inputStream  = [NSInputStream inputStreamWithData:binary];
+    BOOL read = [GRSerialization enumerateObjectsWithBinaryStream:inputStream class:[GRSerializationTestRecord class] options:nil usingBlock:^(id object, BOOL *stop) {
+        [readRecords addObject:object];
+    }];
+    [inputStream close];
+    STAssertTrue(read, nil);
+    [self assertRecords:readRecords equalRecords:records];
+
+    // Read at random
+    GRBinaryStore *store = [[GRBinaryStore alloc] initWithData:binary class:[GRSerializationTestRecord class] options:nil];
+    STAssertNotNil(store, nil);
+    STAssertTrue(store.matchesClass, nil);
+    STAssertEquals(store.count, [records count], nil);
+    [self assertRecords:@[ [store objectAtIndex:2], [store objectAtIndex:0] ] equalRecords:@[ records[2], records[0] ]];
+    STAssertEqualObjects([store valueForProperty:@"title" ofRecordAtIndex:1], [records[1] title], nil);
+    STAssertEqualObjects([store objectValueForProperty:@"publishDate" ofRecordAtIndex:0], record.publishDate, nil);
+    STAssertNil([store valueForProperty:@"title" ofRecordAtIndex:2], nil);
+
+    // JSON isn't binary
+    STAssertNil([[GRBinaryStore alloc] initWithData:[GRSerialization JSONWithObject:records options:nil] class:[GRSerializationTestRecord class] options:nil], nil);
+}
+
+#pragma mark - Dates
+
+-(void)testDatesRoundTrip
+{
+    // Dates are written in UTC to the second, like NSDateFormatter would, including leap days and dates before 1970
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale           = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone         = [NSTimeZone timeZoneWithName:@"UTC"];
+    formatter.dateFormat       = @"yyyy-MM-dd'T'HH:mm:ss'Z'";
+
+    for (NSNumber *interval in @[ @0, @1359635696, @-1, @-2208988800, @951868799, @4107542400 ])
+    {
+        NSDate *date     = [NSDate dateWithTimeIntervalSince1970:[interval doubleValue]];
+        NSString *string = [GRSerialization stringWithDate:date options:nil];
+        STAssertEqualObjects(string, [formatter stringFromDate:date], nil);
+        STAssertEqualObjects([GRSerialization dateWithString:string options:nil], date, nil);
+    }
+
+    STAssertEqualObjects([GRSerialization stringWithDate:[NSDate dateWithTimeIntervalSince1970:1359635696] options:nil], @"2013-01-31T12:34:56Z", nil);
+    STAssertNil([GRSerialization stringWithDate:nil options:nil], nil);
+}
+
+-(void)testDatesWithFractionsAndTimeZones
+{
+    NSDate *date = [NSDate dateWithTimeIntervalSince1970:1359635696];
+
+    // Fractions of a second are read, but not written
+    NSDate *fractionalDate = [GRSerialization dateWithString:@"2013-01-31T12:34:56.789Z" options:nil];
+    STAssertEqualsWithAccuracy([fractionalDate timeIntervalSince1970], 1359635696.789, 0.000001, nil);
+    STAssertEqualObjects([GRSerialization stringWithDate:fractionalDate options:nil], @"2013-01-31T12:34:56Z", nil);
+    STAssertEqualObjects([GRSerialization stringWithDate:[NSDate dateWithTimeIntervalSince1970:-0.5] options:nil], @"1969-12-31T23:59:59Z", nil);
+
+    // Offsets in any form, or no time zone at all for UTC
+    for (NSString *string in @[ @"2013-01-31T12:34:56Z", @"2013-01-31T22:34:56+10:00", @"2013-01-31T22:34:56+1000", @"2013-01-31T22:34:56+10", @"2013-01-31T07:04:56-05:30", @"2013-01-31T12:34:56", @"2013-01-31 12:34:56z" ])
+        STAssertEqualObjects([GRSerialization dateWithString:string options:nil], date, @"%@", string);
+
+    // The seconds and the time are optional
+    STAssertEqualObjects([GRSerialization dateWithString:@"2013-01-31T12:34Z" options:nil], [date dateByAddingTimeInterval:-56], nil);
+    STAssertEqualObjects([GRSerialization dateWithString:@"2013-01-31" options:nil], [NSDate dateWithTimeIntervalSince1970:1359590400], nil);
+}
+
+-(void)testInvalidDates
+{
+    for (NSString *string in @[ @"", @"31/01/2013", @"2013-1-31", @"2013-02-29T00:00:00Z", @"2013-13-01T00:00:00Z", @"2013-01-31T25:00:00Z", @"2013-01-31T24:00:01Z", @"2013-01-31T12:34:56.Z", @"2013-01-31T12:34:56+1", @"2013-01-31T12:34:56+24:00", @"2013-01-31T12:34:56Z junk" ])
+        STAssertNil([GRSerialization dateWithString:string options:nil], @"%@", string);
+
+    STAssertNil([GRSerialization dateWithString:(NSString *)@5 options:nil], nil);
+    STAssertNotNil([GRSerialization dateWithString:@"2012-02-29T00:00:00Z" options:nil], nil);
+}
+
+@end
@@ -0,0 +1,250 @@
+//
+//  GRSourceBenchmarks.m
+//  Gravy
+//
+//  Created by Nathan Tesler on 30/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import "GRBenchmarkTestCase.h"
+#import <objc/runtime.h>
+
+@interface GRBenchmarkNode : GRObject
+@property (strong, nonatomic) NSString *name;
+@property (strong, nonatomic) GRBenchmarkNode *parent;
+@end
+
+@implementation GRBenchmarkNode
+
++(id)source
+{
+    return [GRSource source:self];
+}
+
+@end
+
+/* Coalesces its changes, so its source hears about them once per flush. */
+@interface GRBenchmarkCoalescingNode : GRBenchmarkNode
+@end
+
+@implementation GRBenchmarkCoalescingNode
+
++(BOOL)coalescesChanges
+{
+    return YES;
+}
+
+@end
+
+/* Tracks its changes with setter hooks rather than KVO. It doesn't inherit from GRBenchmarkNode, as the hooks are installed in the class that implements each setter. */
+@interface GRBenchmarkHookedNode : GRObject
+@property (strong, nonatomic) NSString *name;
+@end
+
+@implementation GRBenchmarkHookedNode
+
++(id)source
+{
+    return [GRSource source:self];
+}
+
++(BOOL)observesChangesWithSetterHooks
+{
+    return YES;
+}
+
+@end
+
+/* Counts the changes it hears about. */
+@interface GRBenchmarkObserver : NSObject <GRSourceObserver>
+@property (nonatomic) NSUInteger changeCount;
+@end
+
+@implementation GRBenchmarkObserver
+
+-(void)source:(GRSource *)source didUpdateObject:(GRObject *)object changeType:(GRObjectChangeType)changeType keyPath:(NSString *)keyPath
+{
+    self.changeCount++;
+}
+
+-(void)source:(GRSource *)source didUpdateObjects:(NSArray *)objects changeType:(GRObjectChangeType)changeType
+{
+    self.changeCount += [objects count];
+}
+
+@end
+
+@interface GRSourceBenchmarks : GRBenchmarkTestCase
+@end
+
+@implementation GRSourceBenchmarks
+
+#pragma mark - Helpers
+
+-(NSArray *)classesWithCount:(NSUInteger)count
+{
+    // Classes are made at runtime, so there can be as many sources as we like. Each class is only made once per process.
+    NSMutableArray *classes = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        NSString *name = [NSString stringWithFormat:@"GRSourceBenchmarkClass%lu", (unsigned long)i];
+        Class class    = NSClassFromString(name);
+        if (!class)
+        {
+            class = objc_allocateClassPair([GRObject class], [name UTF8String], 0);
+            objc_registerClassPair(class);
+        }
+        [classes addObject:class];
+    }
+
+    return classes;
+}
+
+-(NSArray *)nodesWithCount:(NSUInteger)count
+{
+    // Each node's parent comes before it, so a store of them can be loaded in order
+    NSMutableArray *nodes = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        GRBenchmarkNode *node = [[GRBenchmarkNode alloc] init];
+        node.name   = [NSString stringWithFormat:@"Node %lu", (unsigned long)i];
+        node.parent = i ? nodes[(i - 1) / 2] : nil;
+        [nodes addObject:node];
+    }
+
+    return nodes;
+}
+
+-(NSTimeInterval)measurePropertyWrites:(NSUInteger)writeCount ofClass:(Class)class
+{
+    // Spread the writes over registered objects, and have an observer listen, as a list on screen would
+    NSMutableArray *nodes = [NSMutableArray array];
+    NSMutableArray *names = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 1000; i++)
+    {
+        [nodes addObject:[[class alloc] init]];
+        [names addObject:[NSString stringWithFormat:@"Name %lu", (unsigned long)i]];
+    }
+
+    GRSource *source              = [class source];
+    GRBenchmarkObserver *observer = [[GRBenchmarkObserver alloc] init];
+    [source registerObjects:nodes];
+    [source registerObserver:observer];
+
+    // The changes only count once the source has heard about them
+    NSTimeInterval duration = [self measure:[NSString stringWithFormat:@"property writes (%@)", [class coalescesChanges] ? @"coalesced" : @"synchronous"] count:writeCount block:^{
+        for (NSUInteger i = 0; i < writeCount; i++)
+            [nodes[i % [nodes count]] setName:names[i / [nodes count] % [names count]]];
+        [source flushChanges];
+    }];
+
+    [source deregisterObserver:observer];
+    STAssertTrue(observer.changeCount > 0, nil);
+
+    return duration;
+}
+
+#pragma mark - Setup
+
+-(void)tearDown
+{
+    for (Class class in @[ [GRBenchmarkNode class], [GRBenchmarkCoalescingNode class] ])
+    {
+        GRSource *source = [class source];
+        [source deregisterObjects:source.objects];
+    }
+
+    [super tearDown];
+}
+
+#pragma mark - Benchmarks
+
+-(void)testSourceLookup
+{
+    // Every source is looked up by its class whenever an object changes, so the lookup shouldn't get slower as sources are added
+    NSUInteger const lookupCount = 100000;
+    for (NSNumber *classCount in @[ @10, @100, @1000 ])
+    {
+        NSArray *classes = [self classesWithCount:[classCount unsignedIntegerValue]];
+        for (Class class in classes)
+            [GRSource source:class];
+
+        __block NSUInteger found = 0;
+        [self measure:[NSString stringWithFormat:@"source lookup with %@ classes", classCount] count:lookupCount block:^{
+            for (NSUInteger i = 0; i < lookupCount; i++)
+                if ([GRSource source:classes[i % [classes count]]])
+                    found++;
+        }];
+
+        STAssertEquals(found, lookupCount, nil);
+    }
+}
+
+-(void)testLoadStoreWithCrossReferences
+{
+    // A store of nodes that refer to their parents by uniqueIdentifier, as GRLocalSource writes them
+    NSUInteger const nodeCount = 50000;
+    NSArray *nodes             = [self nodesWithCount:nodeCount];
+    NSData *store              = [GRSerialization JSONWithObject:nodes options:nil];
+
+    // Loading looks up the parent of every node as it's read
+    GRSource *source = [GRBenchmarkNode source];
+    [self measure:@"load store with cross-references" count:nodeCount block:^{
+        NSInputStream *stream = [NSInputStream inputStreamWithData:store];
+        [source performBatchUpdates:^{
+            [GRSerialization enumerateObjectsWithJSONStream:stream class:[GRBenchmarkNode class] options:nil usingBlock:^(GRBenchmarkNode *node, BOOL *stop) {
+                [node save];
+            }];
+        }];
+        [stream close];
+    }];
+
+    NSArray *loadedNodes = source.objects;
+    STAssertEquals([loadedNodes count], nodeCount, nil);
+    for (NSUInteger i = 1; i < [loadedNodes count]; i++)
+    {
+        GRBenchmarkNode *node = loadedNodes[i];
+        if (node.parent != loadedNodes[(i - 1) / 2])
+        {
+            STFail(@"%@ should refer to the loaded %@", node.name, [nodes[(i - 1) / 2] name]);
+            break;
+        }
+    }
+
+    __block NSUInteger found = 0;
+    [self measure:@"uniqueIdentifier lookup" count:nodeCount block:^{
+        for (GRBenchmarkNode *node in nodes)
+            if ([source objectWithUniqueIdentifier:node.uniqueIdentifier])
+                found++;
+    }];
+    STAssertEquals(found, nodeCount, nil);
+}
+
+-(void)testPropertyWrites
+{
+    // The same writes, notified as they happen or once per object when the source flushes
+    [self measurePropertyWrites:100000 ofClass:[GRBenchmarkNode class]];
+    [self measurePropertyWrites:100000 ofClass:[GRBenchmarkCoalescingNode class]];
+}
+
+-(void)testObjectCreation
+{
+    // Objects observing their own properties with KVO register (and remove) an observer per property, hooked objects don't
+    NSUInteger const objectCount = 100000;
+    for (Class class in @[ [GRBenchmarkNode class], [GRBenchmarkHookedNode class] ])
+    {
+        __block NSUInteger created = 0;
+        [self measure:[NSString stringWithFormat:@"create and dealloc (%@)", [class observesChangesWithSetterHooks] ? @"setter hooks" : @"KVO"] count:objectCount block:^{
+            for (NSUInteger i = 0; i < objectCount; i++)
+            {
+                @autoreleasepool {
+                    if ([[class alloc] init])
+                        created++;
+                }
+            }
+        }];
+        STAssertEquals(created, objectCount, nil);
+    }
+}
+
+@end
@@ -0,0 +1,423 @@
+//
+//  GRSourceTests.m
+//  Gravy
+//
+//  Created by Nathan Tesler on 30/01/13.
+//  Copyright (c) 2013 Nathan Tesler. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface GRSourceTestAuthor : GRObject
+@property (strong, nonatomic) NSString *name;
+@end
+
+@interface GRSourceTestPost : GRObject
+@property (strong, nonatomic) NSString *title;
+@property (strong, nonatomic) NSString *status;
+@property (strong, nonatomic) GRSourceTestAuthor *author;
+@end
+
+/* Drafts coalesce their changes, so their source only hears about them when it flushes. */
+@interface GRSourceTestDraft : GRObject
+@property (strong, nonatomic) NSString *status;
+@end
+
+/* Records the messages it receives from sources, one object change at a time. */
+@interface GRSourceTestObserver : NSObject <GRSourceObserver>
+@property (strong, nonatomic) NSMutableArray *objectChanges;
+@end
+
+/* Also takes changes in batches, one message per type of change. */
+@interface GRSourceTestBatchObserver : GRSourceTestObserver
+@property (strong, nonatomic) NSMutableArray *batches;
+@end
+
+/* Takes changes as change sets instead. */
+@interface GRSourceTestChangeSetObserver : GRSourceTestObserver
+@property (strong, nonatomic) NSMutableArray *changeSets;
+@end
+
+@implementation GRSourceTestAuthor
+
++(id)source
+{
+    return [GRSource source:self];
+}
+
+@end
+
+@implementation GRSourceTestPost
+
++(id)source
+{
+    return [GRSource source:self];
+}
+
++(NSArray *)indexedProperties
+{
+    return @[ @"status", @"author" ];
+}
+
+@end
+
+@implementation GRSourceTestDraft
+
++(id)source
+{
+    return [GRSource source:self];
+}
+
++(NSArray *)indexedProperties
+{
+    return @[ @"status" ];
+}
+
++(BOOL)coalescesChanges
+{
+    return YES;
+}
+
+@end
+
+@implementation GRSourceTestObserver
+
+-(id)init
+{
+    if (self = [super init])
+        _objectChanges = [NSMutableArray array];
+
+    return self;
+}
+
+-(void)source:(GRSource *)source didUpdateObject:(GRObject *)object changeType:(GRObjectChangeType)changeType keyPath:(NSString *)keyPath
+{
+    [self.objectChanges addObject:@[ object, @(changeType) ]];
+}
+
+@end
+
+@implementation GRSourceTestBatchObserver
+
+-(id)init
+{
+    if (self = [super init])
+        _batches = [NSMutableArray array];
+
+    return self;
+}
+
+-(void)source:(GRSource *)source didUpdateObjects:(NSArray *)objects changeType:(GRObjectChangeType)changeType
+{
+    [self.batches addObject:@[ objects, @(changeType) ]];
+}
+
+@end
+
+@implementation GRSourceTestChangeSetObserver
+
+-(id)init
+{
+    if (self = [super init])
+        _changeSets = [NSMutableArray array];
+
+    return self;
+}
+
+-(void)source:(GRSource *)source didChangeObjects:(GRSourceChangeSet *)changeSet
+{
+    [self.changeSets addObject:changeSet];
+}
+
+@end
+
+@interface GRSourceTests : SenTestCase
+@end
+
+@implementation GRSourceTests
+
+#pragma mark - Helpers
+
+-(GRSourceTestPost *)savedPostWithTitle:(NSString *)title status:(NSString *)status author:(GRSourceTestAuthor *)author
+{
+    GRSourceTestPost *post = [[GRSourceTestPost alloc] init];
+    post.title  = title;
+    post.status = status;
+    post.author = author;
+    [post save];
+
+    return post;
+}
+
+#pragma mark - Setup
+
+-(void)setUp
+{
+    [super setUp];
+
+    // Sources live as long as the process, so start every test with empty ones
+    for (Class class in @[ [GRSourceTestAuthor class], [GRSourceTestPost class], [GRSourceTestDraft class] ])
+    {
+        GRSource *source = [class source];
+        [source flushChanges];
+        [source deregisterObjects:source.objects];
+        [source flushChanges];
+    }
+}
+
+#pragma mark - Property lookups
+
+-(void)testObjectsWithValueForIndexedProperty
+{
+    GRSourceTestPost *draft     = [self savedPostWithTitle:@"First" status:@"draft" author:nil];
+    GRSourceTestPost *published = [self savedPostWithTitle:@"Second" status:@"published" author:nil];
+    GRSource *source            = [GRSourceTestPost source];
+
+    STAssertEqualObjects([source objectsWithValue:@"draft" forProperty:@"status"], @[ draft ], nil);
+    STAssertEqualObjects([source objectsWithValue:@"published" forProperty:@"status"], @[ published ], nil);
+    STAssertEquals([[source objectsWithValue:@"archived" forProperty:@"status"] count], (NSUInteger)0, nil);
+
+    // Changing the value moves the object to its new bucket
+    draft.status = @"published";
+    STAssertEquals([[source objectsWithValue:@"draft" forProperty:@"status"] count], (NSUInteger)0, nil);
+    STAssertEquals([[source objectsWithValue:@"published" forProperty:@"status"] count], (NSUInteger)2, nil);
+
+    // Removed objects and nil values aren't found
+    [published remove];
+    draft.status = nil;
+    STAssertEquals([[source objectsWithValue:@"published" forProperty:@"status"] count], (NSUInteger)0, nil);
+    STAssertEqualObjects([source objectsWithValue:nil forProperty:@"status"], @[ draft ], nil);
+}
+
+-(void)testObjectsWithValueForRelationship
+{
+    GRSourceTestAuthor *author = [[GRSourceTestAuthor alloc] init];
+    [author save];
+    GRSourceTestPost *post = [self savedPostWithTitle:@"Mine" status:nil author:author];
+    [self savedPostWithTitle:@"Someone else's" status:nil author:nil];
+
+    // Relationships can be looked up by the related object or its uniqueIdentifier
+    GRSource *source = [GRSourceTestPost source];
+    STAssertEqualObjects([source objectsWithValue:author forProperty:@"author"], @[ post ], nil);
+    STAssertEqualObjects([source objectsWithValue:author.uniqueIdentifier forProperty:@"author"], @[ post ], nil);
+    STAssertEqualObjects([author relationship:@"author" ofClass:[GRSourceTestPost class]], @[ post ], nil);
+}
+
+-(void)testObjectsWithValueForUnindexedProperty
+{
+    GRSourceTestPost *post = [self savedPostWithTitle:@"Scanned" status:nil author:nil];
+    [self savedPostWithTitle:@"Other" status:nil author:nil];
+
+    STAssertEqualObjects([[GRSourceTestPost source] objectsWithValue:@"Scanned" forProperty:@"title"], @[ post ], nil);
+}
+
+-(void)testObjectsMatchingPredicateOnIndexedProperty
+{
+    GRSourceTestPost *post = [self savedPostWithTitle:@"Wanted" status:@"published" author:nil];
+    [self savedPostWithTitle:@"Unwanted" status:@"published" author:nil];
+    [self savedPostWithTitle:@"Wanted" status:@"draft" author:nil];
+
+    // The index narrows the candidates, the rest of the predicate still applies
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"status == %@ AND title == %@", @"published", @"Wanted"];
+    STAssertEqualObjects([[GRSourceTestPost source] objectsMatchingPredicate:predicate], @[ post ], nil);
+}
+
+-(void)testIndexedLookupSeesCoalescedChanges
+{
+    GRSourceTestDraft *draft = [[GRSourceTestDraft alloc] init];
+    draft.status = @"writing";
+    [draft save];
+    [[GRSourceTestDraft source] flushChanges];
+
+    // The change hasn't been flushed yet, but the lookup flushes it first
+    draft.status = @"done";
+    GRSource *source = [GRSourceTestDraft source];
+    STAssertEqualObjects([source objectsWithValue:@"done" forProperty:@"status"], @[ draft ], nil);
+    STAssertEquals([[source objectsWithValue:@"writing" forProperty:@"status"] count], (NSUInteger)0, nil);
+}
+
+#pragma mark - Batch updates
+
+/* Objects tell their source about changes made before they're saved too, so the tests set up the objects they insert before observing. */
+
+-(void)testBatchUpdatesNotifyOnceWhenTheBatchEnds
+{
+    NSArray *posts                      = @[ [[GRSourceTestPost alloc] init], [[GRSourceTestPost alloc] init], [[GRSourceTestPost alloc] init] ];
+    GRSourceTestBatchObserver *observer = [[GRSourceTestBatchObserver alloc] init];
+    GRSource *source                    = [GRSourceTestPost source];
+    [source registerObserver:observer];
+
+    [source performBatchUpdates:^{
+        for (GRSourceTestPost *post in posts)
+            [post save];
+
+        // The objects are registered right away, but observers wait for the batch to end
+        STAssertEquals([source.objects count], (NSUInteger)3, nil);
+        STAssertEquals([observer.batches count], (NSUInteger)0, nil);
+    }];
+    [source deregisterObserver:observer];
+
+    STAssertEqualObjects(observer.batches, (@[ @[ posts, @(GRObjectChangeTypeInsert) ] ]), nil);
+    STAssertEquals([observer.objectChanges count], (NSUInteger)0, nil);
+}
+
+-(void)testBatchUpdatesCoalesceChanges
+{
+    GRSourceTestPost *existing          = [self savedPostWithTitle:@"Existing" status:nil author:nil];
+    GRSourceTestPost *inserted          = [[GRSourceTestPost alloc] init];
+    GRSourceTestPost *removed           = [[GRSourceTestPost alloc] init];
+    GRSourceTestBatchObserver *observer = [[GRSourceTestBatchObserver alloc] init];
+    GRSource *source                    = [GRSourceTestPost source];
+    [source registerObserver:observer];
+
+    [source performBatchUpdates:^{
+        // Inserted then updated is an insert, inserted then removed is never mentioned
+        [inserted save];
+        inserted.status = @"published";
+        [removed save];
+        [removed remove];
+
+        // Nested batches are delivered when the outermost one ends
+        [source performBatchUpdates:^{
+            existing.title  = @"Updated";
+            existing.status = @"published";
+        }];
+        STAssertEquals([observer.batches count], (NSUInteger)0, nil);
+    }];
+    [source deregisterObserver:observer];
+
+    STAssertEqualObjects(observer.batches, (@[ @[ @[ inserted ], @(GRObjectChangeTypeInsert) ], @[ @[ existing ], @(GRObjectChangeTypeUpdate) ] ]), nil);
+}
+
+-(void)testBatchUpdatesNotifyObserversWithoutBatchSupportOfEachObject
+{
+    GRSourceTestPost *first        = [[GRSourceTestPost alloc] init];
+    GRSourceTestPost *second       = [[GRSourceTestPost alloc] init];
+    GRSourceTestObserver *observer = [[GRSourceTestObserver alloc] init];
+    GRSource *source               = [GRSourceTestPost source];
+    [source registerObserver:observer];
+
+    [source performBatchUpdates:^{
+        [first save];
+        [second save];
+        STAssertEquals([observer.objectChanges count], (NSUInteger)0, nil);
+    }];
+    [source deregisterObserver:observer];
+
+    STAssertEqualObjects(observer.objectChanges, (@[ @[ first, @(GRObjectChangeTypeInsert) ], @[ second, @(GRObjectChangeTypeInsert) ] ]), nil);
+}
+
+-(void)testRegisterObjectsNotifiesOnce
+{
+    NSArray *posts                      = @[ [[GRSourceTestPost alloc] init], [[GRSourceTestPost alloc] init] ];
+    GRSourceTestBatchObserver *observer = [[GRSourceTestBatchObserver alloc] init];
+    GRSource *source                    = [GRSourceTestPost source];
+    [source registerObserver:observer];
+
+    [source registerObjects:posts];
+    STAssertEqualObjects(source.objects, posts, nil);
+    [source deregisterObjects:posts];
+    [source deregisterObserver:observer];
+
+    STAssertEqualObjects(observer.batches, (@[ @[ posts, @(GRObjectChangeTypeInsert) ], @[ posts, @(GRObjectChangeTypeDelete) ] ]), nil);
+    STAssertEquals([source.objects count], (NSUInteger)0, nil);
+}
+
+#pragma mark - Change sets
+
+-(void)testChangeSetCoalescesUpdatesUntilFlushed
+{
+    GRSourceTestPost *post                  = [self savedPostWithTitle:@"Title" status:nil author:nil];
+    GRSourceTestChangeSetObserver *observer = [[GRSourceTestChangeSetObserver alloc] init];
+    GRSource *source                        = [GRSourceTestPost source];
+    [source registerObserver:observer];
+
+    post.title  = @"New title";
+    post.status = @"published";
+    post.title  = @"Newer title";
+    STAssertEquals([observer.changeSets count], (NSUInteger)0, @"Change sets wait for the end of the run loop turn");
+
+    [source flushChanges];
+    [source deregisterObserver:observer];
+
+    STAssertEquals([observer.changeSets count], (NSUInteger)1, nil);
+    GRSourceChangeSet *changeSet = [observer.changeSets lastObject];
+    STAssertEqualObjects(changeSet.updatedObjects, @[ post ], nil);
+    STAssertEqualObjects([changeSet changedKeyPathsForObject:post], ([NSSet setWithObjects:@"title", @"status", nil]), nil);
+    STAssertEquals(changeSet.count, (NSUInteger)1, nil);
+    STAssertEquals([observer.objectChanges count], (NSUInteger)0, @"Change set observers don't get single changes");
+}
+
+-(void)testChangeSetCoalescesInsertsAndDeletes
+{
+    GRSourceTestPost *updated               = [self savedPostWithTitle:@"Updated" status:nil author:nil];
+    GRSourceTestPost *deleted               = [self savedPostWithTitle:@"Deleted" status:nil author:nil];
+    GRSourceTestPost *reinserted            = [self savedPostWithTitle:@"Reinserted" status:nil author:nil];
+    GRSourceTestPost *inserted              = [[GRSourceTestPost alloc] init];
+    GRSourceTestPost *transient             = [[GRSourceTestPost alloc] init];
+    GRSourceTestChangeSetObserver *observer = [[GRSourceTestChangeSetObserver alloc] init];
+    GRSource *source                        = [GRSourceTestPost source];
+    [source registerObserver:observer];
+
+    updated.status = @"published";
+    [deleted remove];
+    [reinserted remove];
+    [reinserted save];
+    [inserted save];
+    inserted.status = @"draft";
+    [transient save];
+    [transient remove];
+    [source flushChanges];
+    [source deregisterObserver:observer];
+
+    // Each object appears once, with its net change
+    STAssertEquals([observer.changeSets count], (NSUInteger)1, nil);
+    GRSourceChangeSet *changeSet = [observer.changeSets lastObject];
+    STAssertEqualObjects(changeSet.insertedObjects, @[ inserted ], nil);
+    STAssertEqualObjects([NSSet setWithArray:changeSet.updatedObjects], ([NSSet setWithObjects:updated, reinserted, nil]), nil);
+    STAssertEqualObjects(changeSet.deletedObjects, @[ deleted ], nil);
+    STAssertEquals(changeSet.count, (NSUInteger)4, nil);
+}
+
+-(void)testChangeSetIsDeliveredAtTheEndOfTheRunLoopTurn
+{
+    GRSourceTestPost *post                  = [self savedPostWithTitle:@"Title" status:nil author:nil];
+    GRSourceTestChangeSetObserver *observer = [[GRSourceTestChangeSetObserver alloc] init];
+    GRSource *source                        = [GRSourceTestPost source];
+    [source registerObserver:observer];
+
+    post.title = @"New title";
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    [source deregisterObserver:observer];
+
+    STAssertEquals([observer.changeSets count], (NSUInteger)1, nil);
+    STAssertEqualObjects([[observer.changeSets lastObject] updatedObjects], @[ post ], nil);
+}
+
+-(void)testChangeSetIncludesCoalescedObjectChanges
+{
+    GRSourceTestDraft *draft = [[GRSourceTestDraft alloc] init];
+    [draft save];
+    GRSource *source = [GRSourceTestDraft source];
+    [source flushChanges];
+
+    GRSourceTestChangeSetObserver *observer = [[GRSourceTestChangeSetObserver alloc] init];
+    [source registerObserver:observer];
+
+    // The object only records its changes until the source flushes them
+    NSDate *updateDate = draft.updateDate;
+    draft.status = @"writing";
+    draft.status = @"done";
+    STAssertEqualObjects(draft.updateDate, updateDate, nil);
+
+    [source flushChanges];
+    [source deregisterObserver:observer];
+
+    STAssertEquals([observer.changeSets count], (NSUInteger)1, nil);
+    GRSourceChangeSet *changeSet = [observer.changeSets lastObject];
+    STAssertEqualObjects(changeSet.updatedObjects, @[ draft ], nil);
+    STAssertEqualObjects([changeSet changedKeyPathsForObject:draft], [NSSet setWithObject:@"status"], nil);
+    STAssertFalse([draft.updateDate isEqualToDate:updateDate], nil);
+}
+
+@end
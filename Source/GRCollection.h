@@ -10,7 +10,7 @@
 #import "GRSource.h"
 #import "GRSerialization.h"
 
-/* GRCollection fetches and manages a dynamic array of GRObjects. You provide parameters (Class, NSSortDescriptior and/or NSPredicate) and GRCollection automatically populates itself with objects from the classes' sources. You can change any of the parameters and the collection will automatically update. GRCollection will also update whenever an object of any of its classes is added, removed or changed.
+/* GRCollection fetches and manages a dynamic array of GRObjects. You provide parameters (Class, NSSortDescriptior and/or NSPredicate) and GRCollection automatically populates itself with objects from the classes' sources. You can change any of the parameters and the collection will automatically update. GRCollection will also update whenever an object of any of its classes is added, removed or changed. Changes from the sources arrive as change sets, once per run loop turn, so many changes in a row cause a single refresh. Call `-flushChanges` on the source if you need the collection to update immediately.
  
  # DataSource
 
@@ -194,17 +194,65 @@
     [self.delegate collectionDidChangeContent:self];
 }
 
+-(void)source:(GRSource *)source didChangeObjects:(GRSourceChangeSet *)changeSet
+{
+    // A single change is handled as before, so the delegate can animate it
+    if ([changeSet count] == 1)
+    {
+        GRObject *object = [[changeSet insertedObjects] lastObject];
+        GRObjectChangeType changeType = GRObjectChangeTypeInsert;
+        if (!object)
+        {
+            object     = [[changeSet deletedObjects] lastObject];
+            changeType = GRObjectChangeTypeDelete;
+        }
+        if (!object)
+        {
+            object     = [[changeSet updatedObjects] lastObject];
+            changeType = GRObjectChangeTypeUpdate;
+        }
+
+        [self source:source didUpdateObject:object changeType:changeType keyPath:[[changeSet changedKeyPathsForObject:object] anyObject]];
+        return;
+    }
+
+    // Only refresh the collection's objects if at least one of the objects is not precluded by the predicate
+    if (self.predicate)
+    {
+        NSArray *currentObjects = self.objects;
+        BOOL affectsCollection = NO;
+        for (NSArray *objects in @[ [changeSet insertedObjects], [changeSet updatedObjects], [changeSet deletedObjects] ])
+        {
+            for (GRObject *object in objects)
+            {
+                if ([self.predicate evaluateWithObject:object] || [currentObjects containsObject:object])
+                {
+                    affectsCollection = YES;
+                    break;
+                }
+            }
+
+            if (affectsCollection)
+                break;
+        }
+
+        if (!affectsCollection)
+            return;
+    }
+
+    // Working out an indexPath per object would mean a refresh per object, so refresh once and have the delegate reload
+    [self refreshObjects];
+    [self.delegate collectionDidRefreshContent:self];
+}
+
 #pragma mark - Populating the array
 
 -(void)refreshObjects
 {
-    // Get all objects from all classes
+    // Get all objects from all classes that match the predicate (the source uses its indexes where it can)
     NSMutableArray *allObjects = [NSMutableArray array];
     for (Class class in self.classes)
-        [allObjects addObjectsFromArray:[[GRSource source:class] objects]];
-
-    // Apply predicates
-    if (self.predicate) [allObjects filterUsingPredicate:self.predicate];
+        [allObjects addObjectsFromArray:[[GRSource source:class] objectsMatchingPredicate:self.predicate]];
 
     // Apply sort descriptors
     if (self.sortDescriptors) [allObjects sortUsingDescriptors:self.sortDescriptors];
@@ -8,10 +8,90 @@
 
 #import "GRSource.h"
 
+// The file formats a GRLocalSource can store its objects in
+enum GRLocalSourceStoreFormat {
+    GRLocalSourceStoreFormatJSON = 0,   // <ClassName>.json, readable and compatible with seed files
+    GRLocalSourceStoreFormatBinary      // <ClassName>.store, GRSerialization's compact binary format
+};
+typedef NSInteger GRLocalSourceStoreFormat;
+
+// The kinds of write a commit can make
+enum GRLocalSourceCommitType {
+    GRLocalSourceCommitTypeNone = 0,    // Nothing had changed, so nothing was written
+    GRLocalSourceCommitTypeJournal,     // The changes were appended to the journal
+    GRLocalSourceCommitTypeStore,       // The store file was rewritten with every object
+    GRLocalSourceCommitTypeShards       // The shards containing changes were rewritten (see `shardCount`)
+};
+typedef NSInteger GRLocalSourceCommitType;
+
 @interface GRLocalSource : GRSource
 
 // Seed with: ClassName.json
 
+/* The format the source's objects are written in. Defaults to GRLocalSourceStoreFormatJSON. The source reads whichever store file it finds when it's created, so you can change the format at any time: setting a new format commits the store in that format and removes the file in the old one. To use the binary format for a class, set it when returning the class' source:
+
+    +(GRSource *)source
+    {
+        GRLocalSource *source = [GRLocalSource source:self];
+        source.storeFormat    = GRLocalSourceStoreFormatBinary;
+        return source;
+    }
+ */
+@property (nonatomic) GRLocalSourceStoreFormat storeFormat;
+
+/* The number of files the source's objects are split across. Defaults to 0, which keeps every object in a single store file. Set it to K to partition objects by a hash of their uniqueIdentifier into K segment files (<ClassName>/0.json to <ClassName>/<K-1>.json, or .store in the binary format). A commit then rewrites only the shards whose objects changed, and the shards are decoded in parallel when the source loads (one after another if the class has relationship properties, as they're resolved through sources). Sharded stores don't use the journal or load lazily. Like `storeFormat`, set it when returning the class' source (before setting `storeFormat`, so the store is only migrated once); changing it rewrites the store in the new layout. The new layout is written in full (to <ClassName>.tmp/) before it replaces the old one, so a crash while changing layout leaves one layout or the other, never a mix. */
+@property (nonatomic) NSUInteger shardCount;
+
+///
+/// Commit scheduling
+///
+
+/* Besides committing when the app resigns active, the source commits on its own as objects change, so a crash loses at most a few seconds of changes and writes are spread out rather than made all at once. Changes that come in bursts are coalesced into a single commit: a scheduled commit never happens sooner than `minimumCommitInterval` after the previous commit, and while earlier commits are still being written it waits for them and then commits everything that changed meanwhile. Set a property to 0 to turn that trigger off. */
+
+/* Commit as soon as this many changes have been made since the last commit. Every insert, update and deletion counts, so an object updated over and over counts each time. Defaults to 1000. */
+@property (nonatomic) NSUInteger commitChangeCount;
+
+/* Commit once no objects have changed for this many seconds. Defaults to 5. */
+@property (nonatomic) NSTimeInterval commitIdleInterval;
+
+/* The least time between the start of one commit and a scheduled commit, in seconds. Defaults to 1. Calling `-commit` yourself isn't limited. */
+@property (nonatomic) NSTimeInterval minimumCommitInterval;
+
+/* Commit once the oldest uncommitted change has waited this many seconds, even if objects keep changing (which would hold off the idle commit indefinitely). Defaults to 30. Like every scheduled commit, it still waits for `minimumCommitInterval` and for earlier commits to be written. */
+@property (nonatomic) NSTimeInterval maximumCommitLatency;
+
+/* Saves the changes made since the last commit, on a background queue. The source commits automatically when the app resigns active. Rather than rewriting the store file every time, a commit appends the objects that were inserted, updated and deleted to a journal (<ClassName>.journal), so its cost depends on how much changed rather than on how many objects there are. The journal is replayed over the store file when the source is loaded, and compacted into it (the store file is rewritten and the journal removed) once it holds changes to about half the objects, or when the store format changes. Each journal entry is checksummed and synced to disk, so if the app is killed while appending, the damaged entry is dropped on the next launch and every earlier commit survives.
+
+ Everything a commit writes is encoded on the calling thread before it returns, so you can keep changing objects while the commit is written, and it always saves the objects as they were when you called it. In the binary format, the store file is mapped once it's been read or written, and rewriting it copies the records of objects that haven't changed since, so it only encodes what changed, without holding any encodings in memory. Commits are written one at a time in order, and a commit that rewrites the store skips earlier commits that haven't been written yet, since it includes their changes. The changes a commit takes stay with it until it has been written: if the write fails (or the store write that skipped it fails), they're marked as changed again and the next commit writes them, rewriting the store file rather than trusting a journal that couldn't be appended to. */
 -(void)commit;
 
+///
+/// Metrics
+///
+
+/* The number of objects inserted or updated since the last commit. Objects that coalesce their changes (see GRObject's `+coalescesChanges`) are only counted once their changes have been flushed. */
+@property (nonatomic, readonly) NSUInteger dirtyObjectCount;
+
+/* The number of objects deleted since the last commit. */
+@property (nonatomic, readonly) NSUInteger deletedObjectCount;
+
+/* What the last commit wrote. A commit when nothing has changed returns right away, without encoding or writing anything, and is reported as GRLocalSourceCommitTypeNone. The metrics of a commit that writes are set on the main queue once the write has finished, and aren't updated if it fails. */
+@property (nonatomic, readonly) GRLocalSourceCommitType lastCommitType;
+
+/* The number of objects the last commit wrote: the changed and deleted objects for a journal entry, every object for the store file, the objects in the rewritten shards for a sharded store. */
+@property (nonatomic, readonly) NSUInteger lastCommitObjectCount;
+
+/* The number of bytes the last commit wrote. */
+@property (nonatomic, readonly) NSUInteger lastCommitByteCount;
+
+/* The time the last commit took, encoding on the calling thread plus writing in the background (not counting time spent waiting for earlier commits). */
+@property (nonatomic, readonly) NSTimeInterval lastCommitDuration;
+
+///
+/// Errors
+///
+
+/* Set if a store file or shard couldn't be read in full when the source was loaded (NSFileReadCorruptFileError, with the file in NSFilePathErrorKey). The objects read before the damage are loaded, and the file is copied to <file>.damaged before the next commit replaces it with them. Nil if everything loaded. */
+@property (strong, nonatomic, readonly) NSError *loadError;
+
 @end
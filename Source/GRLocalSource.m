@@ -8,16 +8,129 @@
 
 #import "GRLocalSource.h"
 #import "GRSerialization.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+// The journal file starts with this, followed by the inode of the store file its entries apply to
+static const char GRLocalSourceJournalMagic[4] = { 'G', 'R', 'J', 0x01 };
+static const size_t GRLocalSourceJournalHeaderLength = 12;
+
+// The journal is compacted into the store file once it holds changes to more than half the objects, or this many changes for small stores
+static const NSUInteger GRLocalSourceJournalMinimumCompactionCount = 256;
+
+static uint32_t GRLocalSourceHash(const uint8_t *bytes, NSUInteger length);
+static BOOL GRLocalSourceSyncPath(NSString *path);
+static void GRLocalSourceJournalAppendUInt32(NSMutableData *data, uint32_t value);
+static BOOL GRLocalSourceJournalReadUInt32(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, uint32_t *value);
+
+/* GRLocalSourceCommitChanges is what a commit takes from the source's dirty state: the objects it writes, the deletions and the shards. The source holds on to it until the commit has been written, and marks the changes as changed again if the write fails. */
+@interface GRLocalSourceCommitChanges : NSObject
+
+@property (strong, nonatomic) NSMutableOrderedSet *objects;
+@property (strong, nonatomic) NSMutableOrderedSet *deletedUniqueIdentifiers;
+@property (strong, nonatomic) NSMutableIndexSet *shards;
+
+/* The number of changes the commit took, for scheduling (an object changed twice counts twice). */
+@property (nonatomic) NSUInteger changeCount;
+
+/* The journaled changes a store write folds into the store, which are still only in the journal if it fails. */
+@property (nonatomic) NSUInteger journaledChangeCount;
+
+/* Takes over the changes of a commit that was skipped for this one. */
+-(void)addChanges:(GRLocalSourceCommitChanges *)changes;
+
+@end
+
+@interface GRLocalSource ()
+
+@property (nonatomic, readwrite) GRLocalSourceCommitType lastCommitType;
+@property (nonatomic, readwrite) NSUInteger lastCommitObjectCount;
+@property (nonatomic, readwrite) NSUInteger lastCommitByteCount;
+@property (nonatomic, readwrite) NSTimeInterval lastCommitDuration;
+@property (strong, nonatomic, readwrite) NSError *loadError;
+
+@end
 
 @implementation GRLocalSource
+{
+    // The format of the store file on disk
+    GRLocalSourceStoreFormat _storedFormat;
+
+    // The number of shards on disk (0 for a single store file), the registered objects in each shard when the source is sharded, and the shards with changes since the last commit
+    NSUInteger _storedShardCount;
+    NSMutableArray *_shards;
+    NSMutableIndexSet *_dirtyShards;
+
+    // The binary store file as it was last read or written, mapped, and the record in it of each object that hasn't changed since (every fault, for classes that load lazily). Store writes copy those records rather than encoding the objects again.
+    GRBinaryStore *_mappedStore;
+    NSMutableDictionary *_recordIndexesByUniqueIdentifier;
+
+    // For classes that load lazily, the uniqueIdentifiers of the faults we registered, in order, whether they've fired since or not (but not those removed since). Store writes keep them in that place.
+    NSMutableOrderedSet *_faultedUniqueIdentifiers;
+
+    // For each binary store write waiting to be written, in order: the uniqueIdentifiers of the objects changed since it took its snapshot, whose records in it will be out of date
+    NSMutableArray *_uniqueIdentifiersChangedSinceStoreWrites;
+
+    // Commits are written in order, on a queue of their own. They're numbered as they're made: a store write supersedes every commit made before it, so those still waiting on the queue are skipped. The changes of each commit are kept until it has been written, or until the store write that skipped it has.
+    dispatch_queue_t _commitQueue;
+    NSUInteger _commitCount;
+    NSUInteger _supersedingCommit;
+    NSMutableDictionary *_changesByCommit;
+
+    // The commit scheduler's state: the changes made since the last commit, when the first and last of them were made and when we last committed, the commits waiting on the queue, and whether a scheduled commit is waiting for time to pass or for those commits to be written
+    BOOL _loaded;
+    NSUInteger _uncommittedChangeCount;
+    CFAbsoluteTime _firstChangeTime;
+    CFAbsoluteTime _lastChangeTime;
+    CFAbsoluteTime _lastCommitTime;
+    NSUInteger _writesInFlight;
+    BOOL _idleCheckScheduled;
+    BOOL _latencyCheckScheduled;
+    BOOL _commitScheduled;
+    BOOL _commitWaitingForWrites;
+
+    // The changes since the last commit: objects that were inserted or updated, and the uniqueIdentifiers of those that were deleted
+    NSMutableOrderedSet *_changedObjects;
+    NSMutableOrderedSet *_deletedUniqueIdentifiers;
+
+    // The number of changes in the journal since the store file was last written
+    NSUInteger _journaledChangeCount;
+
+    // Whether the next commit must rewrite the store file: it couldn't be read in full (so it's rewritten with what we did read), or appending to its journal failed
+    BOOL _storeNeedsRewrite;
+
+    // While loading: the objects and deletions replayed from the journal, which take precedence over the store file
+    NSMutableDictionary *_replayedObjects;
+    NSMutableArray *_replayedUniqueIdentifiers;
+    NSMutableSet *_replayedDeletions;
+}
 
 -(id)initWithManagedClass:(Class)managedClass
 {
     if (self = [super initWithManagedClass:managedClass])
     {
+        _commitQueue              = dispatch_queue_create("org.thegravytrain.localsource.commit", NULL);
+        _changesByCommit          = [NSMutableDictionary dictionary];
+        _changedObjects           = [NSMutableOrderedSet orderedSet];
+        _deletedUniqueIdentifiers = [NSMutableOrderedSet orderedSet];
+        _dirtyShards              = [NSMutableIndexSet indexSet];
+        _uniqueIdentifiersChangedSinceStoreWrites = [NSMutableArray array];
+        _commitChangeCount        = 1000;
+        _commitIdleInterval       = 5;
+        _minimumCommitInterval    = 1;
+        _maximumCommitLatency     = 30;
+
         [self seed];
         [self loadObjects];
         [self addCommitTriggers];
+
+        // Loading registers objects, but they're already on disk
+        [_changedObjects removeAllObjects];
+        [_deletedUniqueIdentifiers removeAllObjects];
+        _loaded = YES;
     }
 
     return self;
@@ -37,7 +150,7 @@
     if (filePath)
     {
         // Move the file to the store path
-        [[[NSFileManager alloc] init] copyItemAtPath:filePath toPath:[self storePath] error:nil];
+        [[[NSFileManager alloc] init] copyItemAtPath:filePath toPath:[self storePathForFormat:GRLocalSourceStoreFormatJSON] error:nil];
 
         // Set DidSeedData
         [[NSUserDefaults standardUserDefaults] setBool:YES forKey:GRLocalSourceDidSeedDataKey];
@@ -47,50 +160,1171 @@
 
 -(void)loadObjects
 {
-    // Create Data directory if it doesn't exist
     NSFileManager *fileManager = [[NSFileManager alloc] init];
 
-    // Get or create .json store file
-    if ([fileManager fileExistsAtPath:[self storePath]])
+    // Stores used to be named after the source's class, rather than the managed class, so every class shared one file. It's copied rather than moved, and only if it holds this class' objects.
+    NSString *legacyStorePath = [[[self storePathForFormat:GRLocalSourceStoreFormatJSON] stringByDeletingLastPathComponent] stringByAppendingPathComponent:[NSString stringWithFormat:@"%@.json", NSStringFromClass([self class])]];
+    if (![fileManager fileExistsAtPath:[self storePathForFormat:GRLocalSourceStoreFormatJSON]] && [self legacyStoreHoldsManagedObjectsAtPath:legacyStorePath])
+        [fileManager copyItemAtPath:legacyStorePath toPath:[self storePathForFormat:GRLocalSourceStoreFormatJSON] error:nil];
+
+    // A sharded store is a directory of segment files, which a crash may have left part way through a change of layout
+    [self recoverShardDirectory];
+    NSArray *shardPaths = [self storedShardPaths];
+    if ([shardPaths count])
     {
-        // Get stored data
-        NSData *data = [fileManager contentsAtPath:[self storePath]];
+        [self loadShardsAtPaths:shardPaths];
+        return;
+    }
+
+    // Read the store in whichever format it was last written (binary stores are only written on purpose, so they win)
+    if ([fileManager fileExistsAtPath:[self storePathForFormat:GRLocalSourceStoreFormatBinary]])
+        _storedFormat = GRLocalSourceStoreFormatBinary;
+    else if ([fileManager fileExistsAtPath:[self storePathForFormat:GRLocalSourceStoreFormatJSON]])
+        _storedFormat = GRLocalSourceStoreFormatJSON;
+    else
+    {
+        // Create an empty .json store file
+        _storedFormat = GRLocalSourceStoreFormatJSON;
+        [fileManager createFileAtPath:[self storePathForFormat:GRLocalSourceStoreFormatJSON] contents:nil attributes:nil];
+        return;
+    }
+
+    // Changes committed since the store file was written are in the journal
+    [self replayJournal];
+
+    // Classes that load lazily get a fault per object, rather than the objects themselves
+    if (_storedFormat == GRLocalSourceStoreFormatBinary && [self.managedClass loadsLazily] && [self loadFaults])
+    {
+        [self finishReplayingJournal];
+        return;
+    }
+
+    // Read objects from the store file as they're parsed, rather than reading the whole file into memory first
+    NSInputStream *stream = [NSInputStream inputStreamWithFileAtPath:[self storePathForFormat:_storedFormat]];
+    [stream open];
+
+    // Add each object to its source, notifying observers once at the end rather than once per object
+    GRLocalSourceStoreFormat format = _storedFormat;
+    __block BOOL read = NO;
+    [self performBatchUpdates:^{
+        void (^saveObject)(id, BOOL *) = ^(GRObject *object, BOOL *stop) {
+            // Objects deleted or changed since the store file was written are replaced by their journaled state, in place
+            NSString *uniqueIdentifier = object.uniqueIdentifier;
+            if (uniqueIdentifier && [_replayedDeletions containsObject:uniqueIdentifier])
+                return;
+
+            GRObject *replayedObject = uniqueIdentifier ? _replayedObjects[uniqueIdentifier] : nil;
+            if (replayedObject)
+            {
+                [_replayedObjects removeObjectForKey:uniqueIdentifier];
+                [replayedObject save];
+            }
+            else
+                [object save];
+        };
+
+        if (format == GRLocalSourceStoreFormatBinary)
+            read = [GRSerialization enumerateObjectsWithBinaryStream:stream class:self.managedClass options:nil usingBlock:saveObject];
+        else
+            read = [GRSerialization enumerateObjectsWithJSONStream:stream class:self.managedClass options:nil usingBlock:saveObject];
+    }];
+
+    [stream close];
+
+    // Keep the objects we could read, but keep a copy of the file too, as the next commit replaces it with them. A binary store that was read in full is mapped, so its records can be copied when it's rewritten.
+    if (!read)
+    {
+        [self setAsideDamagedStoreAtPath:[self storePathForFormat:_storedFormat]];
+        _storeNeedsRewrite = YES;
+    }
+    else if (format == GRLocalSourceStoreFormatBinary)
+        [self mapStore];
+
+    [self finishReplayingJournal];
+}
+
+-(BOOL)legacyStoreHoldsManagedObjectsAtPath:(NSString *)path
+{
+    // Legacy stores were read and written whole, so they're small enough to parse here
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    id JSONObject = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    if (![JSONObject isKindOfClass:[NSArray class]] || ![JSONObject count])
+        return NO;
+
+    // Every key of every object must be a property of the managed class, or one the class says it corresponds to
+    NSSet *propertyNames = [NSSet setWithArray:[[self.managedClass classPropertyMetadata] valueForKey:@"name"]];
+    BOOL correspondsKeys = [self.managedClass respondsToSelector:@selector(propertyForCorrespondingKey:context:)];
+    for (NSDictionary *dictionary in JSONObject)
+    {
+        if (![dictionary isKindOfClass:[NSDictionary class]])
+            return NO;
+
+        for (NSString *key in dictionary)
+            if (![propertyNames containsObject:key] && !(correspondsKeys && [propertyNames containsObject:[self.managedClass propertyForCorrespondingKey:key context:nil]]))
+                return NO;
+    }
+
+    return YES;
+}
+
+-(void)loadShardsAtPaths:(NSArray *)shardPaths
+{
+    NSMutableArray *shardObjects = [NSMutableArray arrayWithCapacity:[shardPaths count]];
+    for (NSUInteger i = 0; i < [shardPaths count]; i++)
+        [shardObjects addObject:@[]];
+
+    // Decoding a relationship looks the related object up in its source, which must only happen on this thread. Classes without relationships decode their shards in parallel.
+    BOOL hasRelationships = NO;
+    for (GRPropertyMetadata *metadata in [self.managedClass classPropertyMetadata])
+        if ([metadata.type isEqualToString:@"id"] || [metadata.propertyClass isSubclassOfClass:[GRObject class]])
+            hasRelationships = YES;
+
+    GRLocalSourceStoreFormat format = _storedFormat;
+    Class managedClass              = self.managedClass;
+    NSMutableIndexSet *damagedShards = [NSMutableIndexSet indexSet];
+    void (^decodeShard)(size_t) = ^(size_t shard) {
+        BOOL read;
+        NSMutableArray *objects = [NSMutableArray array];
+        @autoreleasepool {
+            NSInputStream *stream = [NSInputStream inputStreamWithFileAtPath:shardPaths[shard]];
+            [stream open];
+
+            void (^addObject)(id, BOOL *) = ^(id object, BOOL *stop) {
+                [objects addObject:object];
+            };
 
-        // Convert data into objects
-        if ([data length])
+            if (format == GRLocalSourceStoreFormatBinary)
+                read = [GRSerialization enumerateObjectsWithBinaryStream:stream class:managedClass options:nil usingBlock:addObject];
+            else
+                read = [GRSerialization enumerateObjectsWithJSONStream:stream class:managedClass options:nil usingBlock:addObject];
+
+            [stream close];
+        }
+
+        @synchronized(shardObjects)
         {
-            // Serialize all objects
-            NSArray *objects = [GRSerialization objectWithJSON:data class:self.managedClass options:nil];
+            shardObjects[shard] = objects;
+            if (!read)
+                [damagedShards addIndex:shard];
+        }
+    };
 
-            // Add each object to its source
+    if (hasRelationships)
+        for (size_t shard = 0; shard < [shardPaths count]; shard++)
+            decodeShard(shard);
+    else
+        dispatch_apply([shardPaths count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), decodeShard);
+
+    // Register the objects here, shard by shard, notifying observers once at the end
+    [self performBatchUpdates:^{
+        for (NSArray *objects in shardObjects)
             for (GRObject *object in objects)
                 [object save];
+    }];
+
+    // Keep a copy of each shard we couldn't read in full, and rewrite it with the objects we did read on the next commit
+    [damagedShards enumerateIndexesUsingBlock:^(NSUInteger shard, BOOL *stop) {
+        [self setAsideDamagedStoreAtPath:shardPaths[shard]];
+    }];
+    [_dirtyShards addIndexes:damagedShards];
+}
+
+-(void)setAsideDamagedStoreAtPath:(NSString *)path
+{
+    // <file>.damaged, next to the file, replacing one set aside before
+    NSString *damagedPath      = [path stringByAppendingPathExtension:@"damaged"];
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    [fileManager removeItemAtPath:damagedPath error:nil];
+    [fileManager copyItemAtPath:path toPath:damagedPath error:nil];
+
+    NSLog(@"GRLocalSource: %@ couldn't be read in full. The objects that could be read were loaded, and the file was copied to %@.", [path lastPathComponent], damagedPath);
+    self.loadError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{ NSFilePathErrorKey: path, NSLocalizedDescriptionKey: [NSString stringWithFormat:@"%@ couldn't be read in full.", [path lastPathComponent]], NSLocalizedRecoverySuggestionErrorKey: [NSString stringWithFormat:@"The original file was copied to %@.", damagedPath] }];
+}
+
+-(BOOL)loadFaults
+{
+    // We copy the records of faults that never fire when we commit, which we can't do if the class' properties have changed since the store was written. In that case the store is loaded in full, and rewritten in the new layout by the next commit.
+    NSArray *uniqueIdentifiers = [self mapStore];
+    if (!uniqueIdentifiers)
+        return NO;
+
+    [self registerFaultsWithUniqueIdentifiers:uniqueIdentifiers];
+    _faultedUniqueIdentifiers = [NSMutableOrderedSet orderedSetWithArray:uniqueIdentifiers];
+    return YES;
+}
+
+-(NSArray *)mapStore
+{
+    // Map the store file, so only the pages of the records we touch are read from disk
+    NSData *data = [NSData dataWithContentsOfFile:[self storePathForFormat:GRLocalSourceStoreFormatBinary] options:NSDataReadingMappedAlways error:nil];
+    GRBinaryStore *store = data ? [[GRBinaryStore alloc] initWithData:data class:self.managedClass options:nil] : nil;
+    if (!store.matchesClass)
+        return nil;
+
+    // Only the uniqueIdentifier of each record is decoded. Objects in the journal have changed since the store file was written (the replayed objects may already have been registered in place of theirs, so we go by every uniqueIdentifier the journal replayed).
+    NSSet *replayedUniqueIdentifiers   = [NSSet setWithArray:_replayedUniqueIdentifiers];
+    NSMutableArray *uniqueIdentifiers  = [NSMutableArray arrayWithCapacity:store.count];
+    NSMutableDictionary *recordIndexes = [NSMutableDictionary dictionaryWithCapacity:store.count];
+    for (NSUInteger i = 0; i < store.count; i++)
+    {
+        NSString *uniqueIdentifier = [store valueForProperty:@"uniqueIdentifier" ofRecordAtIndex:i];
+        if (![uniqueIdentifier isKindOfClass:[NSString class]])
+            return nil;
+
+        if ([_replayedDeletions containsObject:uniqueIdentifier] || [replayedUniqueIdentifiers containsObject:uniqueIdentifier])
+            continue;
+
+        [uniqueIdentifiers addObject:uniqueIdentifier];
+        recordIndexes[uniqueIdentifier] = @(i);
+    }
+
+    _mappedStore                     = store;
+    _recordIndexesByUniqueIdentifier = recordIndexes;
+
+    return uniqueIdentifiers;
+}
+
+-(GRObject *)objectForFaultWithUniqueIdentifier:(NSString *)uniqueIdentifier
+{
+    // Decode the object from its record in the mapped store
+    NSNumber *recordIndex = _recordIndexesByUniqueIdentifier[uniqueIdentifier];
+    if (!recordIndex)
+        return nil;
+
+    return [_mappedStore objectAtIndex:[recordIndex unsignedIntegerValue]];
+}
+
+-(NSArray *)faultUniqueIdentifiersWithValue:(id)value forProperty:(NSString *)property
+{
+    // If the store doesn't hold the property (eg. the class leaves it out of its serialization), we can't tell without creating the objects
+    if (!_mappedStore || ![_mappedStore.propertyNames containsObject:property])
+        return [super faultUniqueIdentifiersWithValue:value forProperty:property];
+
+    // Relationships are compared by uniqueIdentifier, which the record holds in the related object's unique index, so it isn't looked up
+    BOOL isRelationship = NO;
+    for (GRPropertyMetadata *metadata in [self.managedClass classPropertyMetadata])
+        if ([metadata.name isEqualToString:property])
+            isRelationship = [metadata.type isEqualToString:@"id"] || [metadata.propertyClass isSubclassOfClass:[GRObject class]];
+    if ([value respondsToSelector:@selector(uniqueIdentifier)])
+        value = [value uniqueIdentifier];
+    if (value == [NSNull null])
+        value = nil;
+
+    // Decode only the property from each fault's record, rather than the whole object
+    NSMutableArray *uniqueIdentifiers = [NSMutableArray array];
+    for (NSString *uniqueIdentifier in [self faultUniqueIdentifiers])
+    {
+        @autoreleasepool {
+            NSUInteger recordIndex = [_recordIndexesByUniqueIdentifier[uniqueIdentifier] unsignedIntegerValue];
+            id faultValue;
+            if (isRelationship)
+            {
+                faultValue = [_mappedStore valueForProperty:property ofRecordAtIndex:recordIndex];
+                if ([faultValue isKindOfClass:[NSDictionary class]])
+                    faultValue = faultValue[@"uniqueIdentifier"];
+            }
+            else
+                faultValue = [_mappedStore objectValueForProperty:property ofRecordAtIndex:recordIndex];
+
+            if (faultValue == value || [faultValue isEqual:value])
+                [uniqueIdentifiers addObject:uniqueIdentifier];
+        }
+    }
+
+    return uniqueIdentifiers;
+}
+
+#pragma mark - Journal
+
+-(void)replayJournal
+{
+    _replayedObjects           = [NSMutableDictionary dictionary];
+    _replayedUniqueIdentifiers = [NSMutableArray array];
+    _replayedDeletions         = [NSMutableSet set];
+    _journaledChangeCount      = 0;
+
+    NSString *journalPath = [self journalPath];
+    NSData *journal       = [NSData dataWithContentsOfFile:journalPath options:NSDataReadingMappedIfSafe error:nil];
+    if (!journal)
+        return;
+
+    // A journal written for an earlier store file (eg. if we crashed between replacing the store and removing the journal) is already part of the store
+    const uint8_t *bytes = [journal bytes];
+    NSUInteger length    = [journal length];
+    struct stat storeStat;
+    uint64_t storeInode  = stat([[self storePathForFormat:_storedFormat] fileSystemRepresentation], &storeStat) == 0 ? (uint64_t)storeStat.st_ino : 0;
+    uint64_t journalInode = 0;
+    if (length >= GRLocalSourceJournalHeaderLength)
+        memcpy(&journalInode, bytes + sizeof(GRLocalSourceJournalMagic), sizeof(journalInode));
+    if (length < GRLocalSourceJournalHeaderLength || memcmp(bytes, GRLocalSourceJournalMagic, sizeof(GRLocalSourceJournalMagic)) || CFSwapInt64LittleToHost(journalInode) != storeInode)
+    {
+        unlink([journalPath fileSystemRepresentation]);
+        return;
+    }
+
+    // Each entry is its length, a checksum and the payload. Entries are applied in order; we stop at the first that's incomplete or damaged, which is what a crash while appending leaves behind.
+    NSUInteger offset = GRLocalSourceJournalHeaderLength;
+    while (offset < length)
+    {
+        NSUInteger entryOffset = offset;
+        uint32_t payloadLength, checksum;
+        if (!GRLocalSourceJournalReadUInt32(bytes, length, &offset, &payloadLength) || !GRLocalSourceJournalReadUInt32(bytes, length, &offset, &checksum) || payloadLength > length - offset || GRLocalSourceHash(bytes + offset, payloadLength) != checksum || ![self replayJournalEntry:[journal subdataWithRange:NSMakeRange(offset, payloadLength)]])
+        {
+            // Cut the damaged tail off, so later entries are appended after the last good one
+            truncate([journalPath fileSystemRepresentation], (off_t)entryOffset);
+            break;
         }
 
+        offset += payloadLength;
     }
-    else
-        [fileManager createFileAtPath:[self storePath] contents:nil attributes:nil];
 }
 
+-(BOOL)replayJournalEntry:(NSData *)payload
+{
+    // The payload is the uniqueIdentifiers of the deleted objects, followed by a binary store of the inserted and updated ones
+    const uint8_t *bytes = [payload bytes];
+    NSUInteger length    = [payload length];
+    NSUInteger offset    = 0;
+
+    uint32_t deletionCount;
+    if (!GRLocalSourceJournalReadUInt32(bytes, length, &offset, &deletionCount))
+        return NO;
+
+    NSMutableArray *deletions = [NSMutableArray array];
+    for (uint32_t i = 0; i < deletionCount; i++)
+    {
+        uint32_t stringLength;
+        if (!GRLocalSourceJournalReadUInt32(bytes, length, &offset, &stringLength) || stringLength > length - offset)
+            return NO;
+
+        NSString *uniqueIdentifier = [[NSString alloc] initWithBytes:bytes + offset length:stringLength encoding:NSUTF8StringEncoding];
+        if (!uniqueIdentifier)
+            return NO;
+
+        [deletions addObject:uniqueIdentifier];
+        offset += stringLength;
+    }
+
+    GRBinaryStore *store = [[GRBinaryStore alloc] initWithData:[payload subdataWithRange:NSMakeRange(offset, length - offset)] class:self.managedClass options:nil];
+    if (!store)
+        return NO;
+
+    for (NSString *uniqueIdentifier in deletions)
+    {
+        [_replayedDeletions addObject:uniqueIdentifier];
+        [_replayedObjects removeObjectForKey:uniqueIdentifier];
+    }
+
+    for (NSUInteger i = 0; i < store.count; i++)
+    {
+        GRObject *object = [store objectAtIndex:i];
+        if (!object.uniqueIdentifier)
+            continue;
+
+        if (!_replayedObjects[object.uniqueIdentifier])
+            [_replayedUniqueIdentifiers addObject:object.uniqueIdentifier];
+
+        [_replayedDeletions removeObject:object.uniqueIdentifier];
+        _replayedObjects[object.uniqueIdentifier] = object;
+    }
+
+    _journaledChangeCount += [deletions count] + store.count;
+
+    return YES;
+}
+
+-(void)finishReplayingJournal
+{
+    // Register the journaled objects that weren't in the store file (or, when loading lazily, all of them), in the order they were first journaled
+    [self performBatchUpdates:^{
+        for (NSString *uniqueIdentifier in _replayedUniqueIdentifiers)
+            [_replayedObjects[uniqueIdentifier] save];
+    }];
+
+    _replayedObjects           = nil;
+    _replayedUniqueIdentifiers = nil;
+    _replayedDeletions         = nil;
+}
+
+#pragma mark - Dirty tracking
+
+-(void)registerObject:(GRObject *)object
+{
+    [super registerObject:object];
+    if (_shards)
+        [_shards[[self shardForUniqueIdentifier:object.uniqueIdentifier]] addObject:object];
+
+    [self markObjectChanged:object];
+}
+
+-(void)notifyUpdatedObject:(GRObject *)object withChangedKeyPath:(NSString *)changedKeyPath
+{
+    [super notifyUpdatedObject:object withChangedKeyPath:changedKeyPath];
+
+    // Objects tell their source about every change, including objects that were never saved, have been removed, or are being created for a fault. Only registered objects are ours to write.
+    if ([self containsObject:object])
+        [self markObjectChanged:object];
+}
+
+-(void)deregisterObject:(GRObject *)object
+{
+    // Removing an object that isn't registered doesn't delete anything on disk
+    BOOL registered = [self containsObject:object];
+    [super deregisterObject:object];
+    if (!registered)
+        return;
+
+    // The object's last state doesn't matter, only that it's gone
+    [_changedObjects removeObject:object];
+    [self forgetRecordOfObject:object];
+    if (_shards)
+    {
+        NSUInteger shard = [self shardForUniqueIdentifier:object.uniqueIdentifier];
+        [_shards[shard] removeObject:object];
+        [_dirtyShards addIndex:shard];
+    }
+    if (object.uniqueIdentifier)
+    {
+        [_deletedUniqueIdentifiers addObject:object.uniqueIdentifier];
+        [_faultedUniqueIdentifiers removeObject:object.uniqueIdentifier];
+    }
+
+    [self noteChange];
+}
+
+-(void)markObjectChanged:(GRObject *)object
+{
+    // Remember the object until the next commit, and forget its record in the store
+    [_changedObjects addObject:object];
+    [self forgetRecordOfObject:object];
+    if (_shards)
+        [_dirtyShards addIndex:[self shardForUniqueIdentifier:object.uniqueIdentifier]];
+    if (object.uniqueIdentifier)
+        [_deletedUniqueIdentifiers removeObject:object.uniqueIdentifier];
+
+    [self noteChange];
+}
+
+-(void)forgetRecordOfObject:(GRObject *)object
+{
+    // The object's record in the mapped store, and in any store being written, no longer matches it
+    if (!object.uniqueIdentifier)
+        return;
+
+    [_recordIndexesByUniqueIdentifier removeObjectForKey:object.uniqueIdentifier];
+    for (NSMutableSet *uniqueIdentifiers in _uniqueIdentifiersChangedSinceStoreWrites)
+        [uniqueIdentifiers addObject:object.uniqueIdentifier];
+}
+
+-(NSUInteger)dirtyObjectCount
+{
+    return [_changedObjects count];
+}
+
+-(NSUInteger)deletedObjectCount
+{
+    return [_deletedUniqueIdentifiers count];
+}
+
+#pragma mark - Commit scheduling
+
+-(void)noteChange
+{
+    if (!_loaded)
+        return;
+
+    // Every change counts, including updates to an object that has already changed
+    _uncommittedChangeCount++;
+    _lastChangeTime = CFAbsoluteTimeGetCurrent();
+    if (!_firstChangeTime)
+        _firstChangeTime = _lastChangeTime;
+
+    [self scheduleCommit];
+}
+
+-(void)scheduleCommit
+{
+    if (!_loaded)
+        return;
+
+    // Commit once enough changes have built up
+    if (self.commitChangeCount && _uncommittedChangeCount >= self.commitChangeCount)
+    {
+        [self requestCommit];
+        return;
+    }
+
+    // However the changes keep coming, commit once the oldest has waited long enough
+    if (self.maximumCommitLatency > 0 && _firstChangeTime && !_latencyCheckScheduled)
+    {
+        _latencyCheckScheduled = YES;
+        [self performSelector:@selector(checkLatency) withObject:nil afterDelay:MAX(_firstChangeTime + self.maximumCommitLatency - CFAbsoluteTimeGetCurrent(), 0)];
+    }
+
+    // Otherwise, check back once the changes might have stopped. We don't reschedule the check on every change, it just looks again if there have been more since.
+    if (self.commitIdleInterval > 0 && !_idleCheckScheduled)
+    {
+        _idleCheckScheduled = YES;
+        [self performSelector:@selector(checkIdle) withObject:nil afterDelay:self.commitIdleInterval];
+    }
+}
+
+-(void)checkIdle
+{
+    _idleCheckScheduled = NO;
+    if (![_changedObjects count] && ![_deletedUniqueIdentifiers count])
+        return;
+
+    // Wait out the rest of the idle interval if there have been more changes
+    NSTimeInterval remaining = _lastChangeTime + self.commitIdleInterval - CFAbsoluteTimeGetCurrent();
+    if (remaining > 0)
+    {
+        _idleCheckScheduled = YES;
+        [self performSelector:@selector(checkIdle) withObject:nil afterDelay:remaining];
+        return;
+    }
+
+    [self requestCommit];
+}
+
+-(void)checkLatency
+{
+    _latencyCheckScheduled = NO;
+    if (!_firstChangeTime)
+        return;
+
+    // A commit since the check was scheduled took those changes, so wait on the first change after it
+    NSTimeInterval remaining = _firstChangeTime + self.maximumCommitLatency - CFAbsoluteTimeGetCurrent();
+    if (remaining > 0)
+    {
+        _latencyCheckScheduled = YES;
+        [self performSelector:@selector(checkLatency) withObject:nil afterDelay:remaining];
+        return;
+    }
+
+    [self requestCommit];
+}
+
+-(void)requestCommit
+{
+    // A commit is already on its way, and it'll include these changes
+    if (_commitScheduled || _commitWaitingForWrites)
+        return;
+
+    // Backpressure: while earlier commits are still being written, wait and make one commit of everything that happens meanwhile
+    if (_writesInFlight)
+    {
+        _commitWaitingForWrites = YES;
+        return;
+    }
+
+    // Don't commit more often than the minimum interval
+    NSTimeInterval wait = _lastCommitTime + self.minimumCommitInterval - CFAbsoluteTimeGetCurrent();
+    if (wait > 0)
+    {
+        _commitScheduled = YES;
+        [self performSelector:@selector(performScheduledCommit) withObject:nil afterDelay:wait];
+        return;
+    }
+
+    [self commit];
+}
+
+-(void)performScheduledCommit
+{
+    _commitScheduled = NO;
+    [self requestCommit];
+}
+
+-(void)commitWriteDidFinish
+{
+    _writesInFlight--;
+
+    // Make the commit that was waiting for the queue to drain
+    if (!_writesInFlight && _commitWaitingForWrites)
+    {
+        _commitWaitingForWrites = NO;
+        [self requestCommit];
+    }
+}
+
+#pragma mark - Committing
+
 -(void)addCommitTriggers
 {
     // Add a commit trigger for the WillResignActive notification
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(commit) name:UIApplicationWillResignActiveNotification object:nil];
 }
 
+-(void)setShardCount:(NSUInteger)shardCount
+{
+    // Returning the class' source sets the same count every time, when the objects are already sorted into their shards and the store is in (or on its way to) this layout
+    if (shardCount == _shardCount && (_shards || !shardCount) && shardCount == _storedShardCount)
+        return;
+
+    _shardCount = shardCount;
+
+    // Sort the objects into their shards
+    _shards = nil;
+    if (_shardCount)
+    {
+        _shards = [NSMutableArray arrayWithCapacity:_shardCount];
+        for (NSUInteger i = 0; i < _shardCount; i++)
+            [_shards addObject:[NSMutableOrderedSet orderedSet]];
+
+        for (GRObject *object in self.objects)
+            [_shards[[self shardForUniqueIdentifier:object.uniqueIdentifier]] addObject:object];
+    }
+
+    // Rewrite the store in the new layout
+    if (_shardCount != _storedShardCount)
+        [self commit];
+}
+
+-(NSUInteger)shardForUniqueIdentifier:(NSString *)uniqueIdentifier
+{
+    NSData *string = [uniqueIdentifier dataUsingEncoding:NSUTF8StringEncoding];
+    return string ? GRLocalSourceHash([string bytes], [string length]) % _shardCount : 0;
+}
+
+-(void)setStoreFormat:(GRLocalSourceStoreFormat)storeFormat
+{
+    _storeFormat = storeFormat;
+
+    // Migrate the store to the new format
+    if (_storeFormat != _storedFormat)
+        [self commit];
+}
+
 -(void)commit
 {
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    _lastCommitTime          = startTime;
+
+    // Apply the changes of objects that coalesce them, so they're marked dirty
+    [self flushChanges];
+
+    // If nothing changed, there's nothing to write (unless a store file was damaged, in which case it's rewritten with what we read)
+    NSUInteger changeCount = [_changedObjects count] + [_deletedUniqueIdentifiers count];
+    BOOL changesLayout     = self.storeFormat != _storedFormat || self.shardCount != _storedShardCount;
+    if (!changeCount && !changesLayout && !_storeNeedsRewrite && ![_dirtyShards count])
+    {
+        // Changes that cancelled out (eg. an object inserted and deleted again) don't need a commit either
+        _uncommittedChangeCount = 0;
+        _firstChangeTime        = 0;
+        [self finishCommitWithType:GRLocalSourceCommitTypeNone objectCount:0 byteCount:0 duration:CFAbsoluteTimeGetCurrent() - startTime];
+        return;
+    }
+
+    // Sharded stores rewrite the shards that changed (or all of them, in a new layout)
+    if (self.shardCount)
+    {
+        [self writeShards:changesLayout ? [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, self.shardCount)] : [_dirtyShards copy] changesLayout:changesLayout startTime:startTime];
+        return;
+    }
+
+    // Changing layout rewrites the store. Otherwise the changes are appended to the journal, until it holds so many that replaying it would cost more than rewriting the store.
+    NSUInteger objectCount = [[self objectsWithoutFiringFaults] count] + [[self faultUniqueIdentifiers] count];
+    if (changesLayout || _storeNeedsRewrite || _journaledChangeCount + changeCount > MAX(GRLocalSourceJournalMinimumCompactionCount, objectCount / 2))
+        [self writeStoreWithStartTime:startTime];
+    else
+        [self appendChangesToJournalWithStartTime:startTime];
+}
+
+-(void)finishCommitWithType:(GRLocalSourceCommitType)type objectCount:(NSUInteger)objectCount byteCount:(NSUInteger)byteCount duration:(NSTimeInterval)duration
+{
+    self.lastCommitType        = type;
+    self.lastCommitObjectCount = objectCount;
+    self.lastCommitByteCount   = byteCount;
+    self.lastCommitDuration    = duration;
+}
+
+-(GRLocalSourceCommitChanges *)takeChanges
+{
+    // The commit takes the dirty state as it is, and changes from now on belong to the next commit
+    GRLocalSourceCommitChanges *changes = [[GRLocalSourceCommitChanges alloc] init];
+    changes.objects                  = _changedObjects;
+    changes.deletedUniqueIdentifiers = _deletedUniqueIdentifiers;
+    changes.shards                   = _dirtyShards;
+
+    _changedObjects           = [NSMutableOrderedSet orderedSet];
+    _deletedUniqueIdentifiers = [NSMutableOrderedSet orderedSet];
+    _dirtyShards              = [NSMutableIndexSet indexSet];
+    changes.changeCount       = _uncommittedChangeCount;
+    _uncommittedChangeCount   = 0;
+    _firstChangeTime          = 0;
+
+    return changes;
+}
+
+-(void)restoreChanges:(GRLocalSourceCommitChanges *)changes
+{
+    // The changes weren't written, so they're changes again. Objects deleted since are just deleted, and objects saved again since aren't deleted any more.
+    for (GRObject *object in changes.objects)
+        if (!object.uniqueIdentifier || ![_deletedUniqueIdentifiers containsObject:object.uniqueIdentifier])
+            [_changedObjects addObject:object];
+
+    for (NSString *uniqueIdentifier in changes.deletedUniqueIdentifiers)
+        if (![self objectWithUniqueIdentifier:uniqueIdentifier])
+            [_deletedUniqueIdentifiers addObject:uniqueIdentifier];
+
+    [_dirtyShards addIndexes:changes.shards];
+    _journaledChangeCount += changes.journaledChangeCount;
+
+    // They're uncommitted again. The failed commit is retried anyway, so the latency trigger counts from now.
+    _uncommittedChangeCount += changes.changeCount;
+    if (changes.changeCount && !_firstChangeTime)
+        _firstChangeTime = CFAbsoluteTimeGetCurrent();
+}
+
+-(void)appendChangesToJournalWithStartTime:(CFAbsoluteTime)startTime
+{
+    GRLocalSourceCommitChanges *changes = [self takeChanges];
+
+    // Encode the entry now, so it records the objects as they are when committing
+    NSMutableData *payload = [NSMutableData data];
+    GRLocalSourceJournalAppendUInt32(payload, (uint32_t)[changes.deletedUniqueIdentifiers count]);
+    for (NSString *uniqueIdentifier in changes.deletedUniqueIdentifiers)
+    {
+        NSData *string = [uniqueIdentifier dataUsingEncoding:NSUTF8StringEncoding];
+        GRLocalSourceJournalAppendUInt32(payload, (uint32_t)[string length]);
+        [payload appendData:string];
+    }
+
+    NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+    BOOL encoded = [GRSerialization writeBinaryWithObjects:[changes.objects array] class:self.managedClass toStream:stream options:nil];
+    [payload appendData:[stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey]];
+    [stream close];
+    if (!encoded)
+    {
+        [self restoreChanges:changes];
+        return;
+    }
+
+    NSMutableData *entry = [NSMutableData dataWithCapacity:[payload length] + 8];
+    GRLocalSourceJournalAppendUInt32(entry, (uint32_t)[payload length]);
+    GRLocalSourceJournalAppendUInt32(entry, GRLocalSourceHash([payload bytes], [payload length]));
+    [entry appendData:payload];
+
+    NSUInteger changeCount = [changes.objects count] + [changes.deletedUniqueIdentifiers count];
+    NSTimeInterval encodingDuration = CFAbsoluteTimeGetCurrent() - startTime;
+    _journaledChangeCount += changeCount;
+
+    NSString *storePath   = [self storePathForFormat:_storedFormat];
+    NSString *otherPath   = [self storePathForFormat:_storedFormat == GRLocalSourceStoreFormatBinary ? GRLocalSourceStoreFormatJSON : GRLocalSourceStoreFormatBinary];
+    NSString *journalPath = [self journalPath];
+    [self enqueueCommitWrite:^BOOL{
+
+        CFAbsoluteTime writeStartTime = CFAbsoluteTimeGetCurrent();
+        int fd = open([journalPath fileSystemRepresentation], O_RDWR | O_APPEND | O_CREAT, 0644);
+        if (fd < 0)
+            return NO;
+
+        // The journal applies to the store file its header names. If a store write before us failed, that's still the old store file (maybe in the other format), so we carry on appending to it.
+        struct stat storeStat;
+        uint64_t storeInode = stat([storePath fileSystemRepresentation], &storeStat) == 0 ? (uint64_t)storeStat.st_ino : 0;
+        uint64_t otherInode = stat([otherPath fileSystemRepresentation], &storeStat) == 0 ? (uint64_t)storeStat.st_ino : 0;
+
+        uint8_t header[GRLocalSourceJournalHeaderLength];
+        uint64_t journalInode = 0;
+        BOOL hasHeader = pread(fd, header, sizeof(header), 0) == sizeof(header) && !memcmp(header, GRLocalSourceJournalMagic, sizeof(GRLocalSourceJournalMagic));
+        if (hasHeader)
+        {
+            memcpy(&journalInode, header + sizeof(GRLocalSourceJournalMagic), sizeof(journalInode));
+            journalInode = CFSwapInt64LittleToHost(journalInode);
+        }
+
+        // Only start the journal over if it names neither store file (the store has been rewritten since, and we crashed before removing the old journal). A journal for a store file that exists is never truncated.
+        BOOL startsJournal = !hasHeader || !journalInode || (journalInode != storeInode && journalInode != otherInode);
+        if (startsJournal)
+        {
+            // There must be a store file for the entries to apply to
+            uint64_t inode = storeInode ?: otherInode;
+            if (!inode)
+            {
+                close(fd);
+                return NO;
+            }
+
+            memcpy(header, GRLocalSourceJournalMagic, sizeof(GRLocalSourceJournalMagic));
+            inode = CFSwapInt64HostToLittle(inode);
+            memcpy(header + sizeof(GRLocalSourceJournalMagic), &inode, sizeof(inode));
+            if (ftruncate(fd, 0) != 0 || write(fd, header, sizeof(header)) != (ssize_t)sizeof(header))
+            {
+                close(fd);
+                return NO;
+            }
+        }
+
+        // Append the entry and make sure it's on disk. If the write fails, take back whatever part of it made it.
+        off_t journalLength = lseek(fd, 0, SEEK_END);
+        BOOL written        = write(fd, [entry bytes], [entry length]) == (ssize_t)[entry length] && fsync(fd) == 0;
+        if (!written)
+            ftruncate(fd, journalLength);
+
+        close(fd);
+
+        // A new journal file also needs its directory entry on disk
+        if (written && startsJournal)
+            GRLocalSourceSyncPath([journalPath stringByDeletingLastPathComponent]);
+
+        // Report the commit's cost: encoding on the calling thread plus writing here
+        if (!written)
+            return NO;
+
+        NSTimeInterval duration = encodingDuration + (CFAbsoluteTimeGetCurrent() - writeStartTime);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self finishCommitWithType:GRLocalSourceCommitTypeJournal objectCount:changeCount byteCount:[entry length] duration:duration];
+        });
+
+        return YES;
+    } changes:changes supersedingEarlierCommits:NO completion:^(BOOL written) {
+
+        // The changes are marked again, and written with the store next time rather than trusting the journal
+        if (!written)
+        {
+            _journaledChangeCount -= MIN(changeCount, _journaledChangeCount);
+            _storeNeedsRewrite     = YES;
+        }
+    }];
+}
+
+-(void)writeStoreWithStartTime:(CFAbsoluteTime)startTime
+{
+    // The layout we're leaving, which is still the store's until the write succeeds
+    GRLocalSourceStoreFormat format         = self.storeFormat;
+    GRLocalSourceStoreFormat previousFormat = _storedFormat;
+    NSUInteger previousShardCount           = _storedShardCount;
+    BOOL neededRewrite                      = _storeNeedsRewrite;
+
+    // Take a snapshot of the store by encoding the objects here, so the commit queue never touches objects that we may be changing. In the binary format, objects that haven't changed since the mapped store was written (faults that haven't fired among them, so committing doesn't create every object) are copied from their records in it, so this only costs as much as the changes.
+    GRBinaryStore *mappedStore        = format == GRLocalSourceStoreFormatBinary ? _mappedStore : nil;
+    NSArray *objects                  = mappedStore ? [self objectsAndFaultsInRegistrationOrder] : self.objects;
+    NSMutableArray *encodedObjects    = [NSMutableArray arrayWithCapacity:[objects count]];
+    NSMutableArray *uniqueIdentifiers = [NSMutableArray arrayWithCapacity:[objects count]];
+    for (id objectOrFault in objects)
+    {
+        // Faults are just their uniqueIdentifiers, and always have a record
+        GRObject *object           = [objectOrFault isKindOfClass:[GRObject class]] ? objectOrFault : nil;
+        NSString *uniqueIdentifier = object ? object.uniqueIdentifier : objectOrFault;
+        NSNumber *recordIndex      = uniqueIdentifier ? _recordIndexesByUniqueIdentifier[uniqueIdentifier] : nil;
+        NSData *encodedObject      = (mappedStore && recordIndex) ? [mappedStore recordAtIndex:[recordIndex unsignedIntegerValue]] : [self encodedObject:object format:format];
+        if (!encodedObject)
+            continue;
+
+        [encodedObjects addObject:encodedObject];
+        [uniqueIdentifiers addObject:uniqueIdentifier ?: [NSNull null]];
+    }
+
+    // Objects that change while the store is written won't match their records in it
+    NSMutableSet *changedUniqueIdentifiers = [NSMutableSet set];
+    if (format == GRLocalSourceStoreFormatBinary)
+        [_uniqueIdentifiersChangedSinceStoreWrites addObject:changedUniqueIdentifiers];
 
-        // Turn the objects in the store into an NSData object
-        NSData *soupData = [GRSerialization JSONWithObject:self.objects options:nil];
+    // The store includes every change, so the journal starts over. Later commits assume the new layout; if the write fails, we go back to the old one.
+    NSTimeInterval encodingDuration     = CFAbsoluteTimeGetCurrent() - startTime;
+    GRLocalSourceCommitChanges *changes = [self takeChanges];
+    changes.journaledChangeCount        = _journaledChangeCount;
+    _journaledChangeCount = 0;
+    _storeNeedsRewrite    = NO;
+    _storedFormat         = format;
+    _storedShardCount     = 0;
 
-        // Write data to .soup file asynchronously & atomically
-        [soupData writeToFile:[self storePath] atomically:YES];
+    NSString *storePath      = [self storePathForFormat:format];
+    NSString *otherPath      = [self storePathForFormat:format == GRLocalSourceStoreFormatBinary ? GRLocalSourceStoreFormatJSON : GRLocalSourceStoreFormatBinary];
+    NSString *journalPath    = [self journalPath];
+    __block GRBinaryStore *writtenStore;
+    [self enqueueCommitWrite:^BOOL{
+
+        CFAbsoluteTime writeStartTime = CFAbsoluteTimeGetCurrent();
+        BOOL written = [self writeEncodedObjects:encodedObjects format:format toPath:storePath];
+
+        // The copied records point into the mapped store, so it must outlive the write
+        (void)mappedStore;
+        if (!written)
+            return NO;
+
+        // Map the store we've written, so the next store write can copy from it in turn
+        if (format == GRLocalSourceStoreFormatBinary)
+        {
+            NSData *data = [NSData dataWithContentsOfFile:storePath options:NSDataReadingMappedAlways error:nil];
+            writtenStore = data ? [[GRBinaryStore alloc] initWithData:data class:self.managedClass options:nil] : nil;
+        }
+
+        // If we've changed layout, the shards go first, as they're loaded in preference to the store file
+        if (![self removeShardDirectory])
+            return NO;
+
+        // The journal's entries are now part of the store, which is on disk under its name (if we crash before removing the journal, it's ignored as it names the old store file)
+        unlink([journalPath fileSystemRepresentation]);
+
+        // If we've changed format, the store file in the other format is now out of date
+        unlink([otherPath fileSystemRepresentation]);
+
+        // Report the commit's cost: taking the snapshot on the calling thread plus writing here
+        struct stat storeStat;
+        NSUInteger byteCount    = stat([storePath fileSystemRepresentation], &storeStat) == 0 ? (NSUInteger)storeStat.st_size : 0;
+        NSTimeInterval duration = encodingDuration + (CFAbsoluteTimeGetCurrent() - writeStartTime);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self finishCommitWithType:GRLocalSourceCommitTypeStore objectCount:[encodedObjects count] byteCount:byteCount duration:duration];
+        });
+
+        return YES;
+    } changes:changes supersedingEarlierCommits:YES completion:^(BOOL written) {
+
+        // Earlier store writes have finished (or been skipped) by now
+        NSUInteger storeWriteIndex = [_uniqueIdentifiersChangedSinceStoreWrites indexOfObjectIdenticalTo:changedUniqueIdentifiers];
+        if (storeWriteIndex != NSNotFound)
+            [_uniqueIdentifiersChangedSinceStoreWrites removeObjectsInRange:NSMakeRange(0, storeWriteIndex + 1)];
+
+        // The old store file and its journal are still the store (unless a later commit has moved on to another layout meanwhile)
+        if (!written && _storedFormat == format && !_storedShardCount)
+        {
+            _storedFormat      = previousFormat;
+            _storedShardCount  = previousShardCount;
+            _storeNeedsRewrite = _storeNeedsRewrite || neededRewrite;
+        }
+        else if (written)
+            [self didWriteStore:writtenStore withUniqueIdentifiers:uniqueIdentifiers changedUniqueIdentifiers:changedUniqueIdentifiers];
+    }];
+}
+
+-(NSArray *)objectsAndFaultsInRegistrationOrder
+{
+    // Objects are added to the end of `objects` as their faults fire, but on disk they keep the place their fault was registered in, ahead of the objects registered since. Otherwise every rewrite of the store would reorder `objects` on the next launch.
+    NSMutableDictionary *faultedObjects = [NSMutableDictionary dictionaryWithCapacity:[_faultedUniqueIdentifiers count]];
+    NSMutableArray *registeredObjects   = [NSMutableArray array];
+    for (GRObject *object in [self objectsWithoutFiringFaults])
+    {
+        if (object.uniqueIdentifier && [_faultedUniqueIdentifiers containsObject:object.uniqueIdentifier])
+            faultedObjects[object.uniqueIdentifier] = object;
+        else
+            [registeredObjects addObject:object];
+    }
+
+    // Faults that haven't fired are left as their uniqueIdentifiers
+    NSSet *faults                    = [NSSet setWithArray:[self faultUniqueIdentifiers]];
+    NSMutableArray *objectsAndFaults = [NSMutableArray arrayWithCapacity:[_faultedUniqueIdentifiers count] + [registeredObjects count]];
+    for (NSString *uniqueIdentifier in _faultedUniqueIdentifiers)
+    {
+        id objectOrFault = faultedObjects[uniqueIdentifier] ?: ([faults containsObject:uniqueIdentifier] ? uniqueIdentifier : nil);
+        if (objectOrFault)
+            [objectsAndFaults addObject:objectOrFault];
+    }
+    [objectsAndFaults addObjectsFromArray:registeredObjects];
+
+    return objectsAndFaults;
+}
+
+-(void)didWriteStore:(GRBinaryStore *)store withUniqueIdentifiers:(NSArray *)uniqueIdentifiers changedUniqueIdentifiers:(NSSet *)changedUniqueIdentifiers
+{
+    // Objects that haven't changed since the snapshot are copied from the new store from now on. Faults never change, so every fault has its record in it.
+    if (store.matchesClass && store.count == [uniqueIdentifiers count])
+    {
+        NSMutableDictionary *recordIndexes = [NSMutableDictionary dictionaryWithCapacity:store.count];
+        [uniqueIdentifiers enumerateObjectsUsingBlock:^(id uniqueIdentifier, NSUInteger i, BOOL *stop) {
+            if (uniqueIdentifier != [NSNull null] && ![changedUniqueIdentifiers containsObject:uniqueIdentifier])
+                recordIndexes[uniqueIdentifier] = @(i);
+        }];
+
+        _mappedStore                     = store;
+        _recordIndexesByUniqueIdentifier = recordIndexes;
+    }
+
+    // The old store file is gone, so unless faults still need it, let its mapping go too
+    else if (![[self faultUniqueIdentifiers] count])
+    {
+        _mappedStore                     = nil;
+        _recordIndexesByUniqueIdentifier = nil;
+    }
+}
+
+-(void)writeShards:(NSIndexSet *)shards changesLayout:(BOOL)changesLayout startTime:(CFAbsoluteTime)startTime
+{
+    GRLocalSourceStoreFormat format         = self.storeFormat;
+    GRLocalSourceStoreFormat previousFormat = _storedFormat;
+    NSUInteger previousShardCount           = _storedShardCount;
+    NSUInteger shardCount                   = self.shardCount;
+
+    // Take a snapshot of the shards we're writing, as for a single store file. A new layout is written to a directory of its own, and moved into place once every shard is written.
+    NSString *shardDirectory      = [self shardDirectoryPath];
+    NSString *writeDirectory      = changesLayout ? [self shardDirectoryPathWithExtension:@"tmp"] : shardDirectory;
+    NSMutableArray *encodedShards = [NSMutableArray arrayWithCapacity:[shards count]];
+    NSMutableArray *shardPaths    = [NSMutableArray arrayWithCapacity:[shards count]];
+    [shards enumerateIndexesUsingBlock:^(NSUInteger shard, BOOL *stop) {
+        [encodedShards addObject:[self encodedObjectsWithObjects:[_shards[shard] array] format:format]];
+        [shardPaths addObject:[writeDirectory stringByAppendingPathComponent:[[self shardPathForIndex:shard format:format] lastPathComponent]]];
+    }];
+
+    // Shards don't use the journal. In a new layout every shard is written, so they're all changed again if the write fails.
+    NSTimeInterval encodingDuration     = CFAbsoluteTimeGetCurrent() - startTime;
+    GRLocalSourceCommitChanges *changes = [self takeChanges];
+    [changes.shards addIndexes:shards];
+    changes.journaledChangeCount = _journaledChangeCount;
+    _journaledChangeCount = 0;
+    _storedFormat         = format;
+    _storedShardCount     = shardCount;
+
+    NSArray *staleStorePaths = @[ [self storePathForFormat:GRLocalSourceStoreFormatJSON], [self storePathForFormat:GRLocalSourceStoreFormatBinary], [self journalPath] ];
+    [self enqueueCommitWrite:^BOOL{
+
+        CFAbsoluteTime writeStartTime = CFAbsoluteTimeGetCurrent();
+        NSFileManager *fileManager    = [[NSFileManager alloc] init];
+        if (changesLayout)
+            [fileManager removeItemAtPath:writeDirectory error:nil];
+        [fileManager createDirectoryAtPath:writeDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+
+        // Each shard is replaced atomically. A crash part way through a commit leaves some shards old and some new, but every object is intact.
+        NSUInteger objectCount = 0, byteCount = 0;
+        for (NSUInteger i = 0; i < [shardPaths count]; i++)
+        {
+            if (![self writeEncodedObjects:encodedShards[i] format:format toPath:shardPaths[i]])
+                return NO;
+
+            struct stat shardStat;
+            objectCount += [encodedShards[i] count];
+            byteCount   += stat([shardPaths[i] fileSystemRepresentation], &shardStat) == 0 ? (NSUInteger)shardStat.st_size : 0;
+        }
+
+        // A new layout replaces the old shards in one step, and then the store file and its journal are out of date
+        if (changesLayout)
+        {
+            if (![self replaceShardDirectoryWithDirectoryAtPath:writeDirectory])
+                return NO;
+
+            for (NSString *path in staleStorePaths)
+                unlink([path fileSystemRepresentation]);
+        }
+
+        // Report the commit's cost: taking the snapshot on the calling thread plus writing here
+        NSTimeInterval duration = encodingDuration + (CFAbsoluteTimeGetCurrent() - writeStartTime);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self finishCommitWithType:GRLocalSourceCommitTypeShards objectCount:objectCount byteCount:byteCount duration:duration];
+        });
+
+        return YES;
+    } changes:changes supersedingEarlierCommits:changesLayout completion:^(BOOL written) {
+
+        // A new layout that wasn't written isn't the store's layout
+        if (!written && changesLayout && _storedFormat == format && _storedShardCount == shardCount)
+        {
+            _storedFormat     = previousFormat;
+            _storedShardCount = previousShardCount;
+        }
+    }];
+}
+
+-(NSArray *)encodedObjectsWithObjects:(NSArray *)objects format:(GRLocalSourceStoreFormat)format
+{
+    NSMutableArray *encodedObjects = [NSMutableArray arrayWithCapacity:[objects count]];
+    for (GRObject *object in objects)
+    {
+        NSData *encodedObject = [self encodedObject:object format:format];
+        if (encodedObject)
+            [encodedObjects addObject:encodedObject];
+    }
+
+    return encodedObjects;
+}
+
+-(NSData *)encodedObject:(GRObject *)object format:(GRLocalSourceStoreFormat)format
+{
+    NSData *encodedObject;
+    @autoreleasepool {
+        if (format == GRLocalSourceStoreFormatBinary)
+            encodedObject = [GRSerialization binaryRecordWithObject:object class:self.managedClass options:nil];
+        else
+            encodedObject = [GRSerialization JSONWithObject:object options:nil];
+    }
+
+    return encodedObject;
+}
+
+-(BOOL)writeEncodedObjects:(NSArray *)encodedObjects format:(GRLocalSourceStoreFormat)format toPath:(NSString *)path
+{
+    // Stream the objects to a temporary file, so we never hold the whole serialized store in memory
+    NSString *temporaryPath = [path stringByAppendingPathExtension:@"tmp"];
+    NSOutputStream *stream  = [NSOutputStream outputStreamToFileAtPath:temporaryPath append:NO];
+
+    BOOL written;
+    if (format == GRLocalSourceStoreFormatBinary)
+        written = [GRSerialization writeBinaryWithObjects:nil records:encodedObjects class:self.managedClass toStream:stream options:nil];
+    else
+        written = [GRSerialization writeJSONWithEncodedObjects:encodedObjects toStream:stream];
+
+    [stream close];
+
+    // Make sure the new contents are on disk before they replace the file, or a crash could leave the file empty
+    if (!written || !GRLocalSourceSyncPath(temporaryPath))
+    {
+        unlink([temporaryPath fileSystemRepresentation]);
+        return NO;
+    }
+
+    // Replace the file atomically, then sync its directory so the replacement survives a crash too, before anything that relies on it (like removing the journal) happens
+    if (rename([temporaryPath fileSystemRepresentation], [path fileSystemRepresentation]) != 0)
+        return NO;
+
+    return GRLocalSourceSyncPath([path stringByDeletingLastPathComponent]);
+}
+
+-(void)enqueueCommitWrite:(BOOL (^)(void))write changes:(GRLocalSourceCommitChanges *)changes supersedingEarlierCommits:(BOOL)supersedes completion:(void (^)(BOOL written))completion
+{
+    NSUInteger commit = ++_commitCount;
+    _changesByCommit[@(commit)] = changes;
+    if (supersedes)
+    {
+        @synchronized(self)
+        {
+            _supersedingCommit = commit;
+        }
+    }
+
+    _writesInFlight++;
+    dispatch_async(_commitQueue, ^{
+
+        // If a store write was made after this commit, it includes this commit's changes, so we leave them to it
+        NSUInteger supersedingCommit = [self supersedingCommitForCommit:commit];
+        BOOL written                 = !supersedingCommit && write();
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self commit:commit didFinishWriting:written supersededBy:supersedingCommit completion:completion];
+        });
     });
 }
 
--(NSString *)storePath
+-(void)commit:(NSUInteger)commit didFinishWriting:(BOOL)written supersededBy:(NSUInteger)supersedingCommit completion:(void (^)(BOOL written))completion
+{
+    GRLocalSourceCommitChanges *changes = _changesByCommit[@(commit)];
+    [_changesByCommit removeObjectForKey:@(commit)];
+
+    // A skipped commit's changes are only safe once the store write that skipped it has been written (it's still waiting, as the queue is in order), and a failed commit's changes must be written again
+    if (supersedingCommit)
+        [_changesByCommit[@(supersedingCommit)] addChanges:changes];
+    else
+    {
+        if (!written)
+            [self restoreChanges:changes];
+        if (completion)
+            completion(written);
+
+        // Try again once things have settled
+        if (!written)
+            [self scheduleCommit];
+    }
+
+    [self commitWriteDidFinish];
+}
+
+-(NSUInteger)supersedingCommitForCommit:(NSUInteger)commit
+{
+    @synchronized(self)
+    {
+        return commit < _supersedingCommit ? _supersedingCommit : 0;
+    }
+}
+
+-(NSString *)storePathForFormat:(GRLocalSourceStoreFormat)format
 {
     // Get ~/Library/Data path
     NSArray *paths              = NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES);
@@ -102,8 +1336,173 @@
     if (![fileManager fileExistsAtPath:dataDirectoryPath isDirectory:nil])
         [fileManager createDirectoryAtPath:dataDirectoryPath withIntermediateDirectories:NO attributes:nil error:nil];
 
-    // Return the path of this class' store (<ClassName>.json)
-    return [dataDirectoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@"%@.json", NSStringFromClass([self class])]];
+    // Return the path of the managed class' store (<ClassName>.json or <ClassName>.store)
+    NSString *extension = format == GRLocalSourceStoreFormatBinary ? @"store" : @"json";
+    return [dataDirectoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@"%@.%@", NSStringFromClass(self.managedClass), extension]];
+}
+
+-(NSString *)shardDirectoryPath
+{
+    // <ClassName>/, next to the store file
+    return [[self storePathForFormat:GRLocalSourceStoreFormatJSON] stringByDeletingPathExtension];
+}
+
+-(NSString *)shardPathForIndex:(NSUInteger)shard format:(GRLocalSourceStoreFormat)format
+{
+    // <ClassName>/<index>.json or <ClassName>/<index>.store
+    NSString *extension = format == GRLocalSourceStoreFormatBinary ? @"store" : @"json";
+    return [[self shardDirectoryPath] stringByAppendingPathComponent:[NSString stringWithFormat:@"%lu.%@", (unsigned long)shard, extension]];
+}
+
+-(NSArray *)storedShardPaths
+{
+    NSArray *files = [[[NSFileManager alloc] init] contentsOfDirectoryAtPath:[self shardDirectoryPath] error:nil];
+    if (![files count])
+        return nil;
+
+    // Shards are written in one format at a time; binary shards are only written on purpose, so they win
+    _storedFormat = [[files filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"pathExtension == 'store'"]] count] ? GRLocalSourceStoreFormatBinary : GRLocalSourceStoreFormatJSON;
+
+    // The shard count is the number of segment files, named by index
+    NSMutableArray *shardPaths = [NSMutableArray array];
+    while (YES)
+    {
+        NSString *shardPath = [self shardPathForIndex:[shardPaths count] format:_storedFormat];
+        if (![files containsObject:[shardPath lastPathComponent]])
+            break;
+
+        [shardPaths addObject:shardPath];
+    }
+
+    _storedShardCount = [shardPaths count];
+    return shardPaths;
+}
+
+/* A new layout is written in full to <ClassName>.tmp/ and then renamed into place, so the shard directory always holds one complete layout. Its existence is what makes the store sharded, so switching to or from shards is a single rename too. */
+
+-(NSString *)shardDirectoryPathWithExtension:(NSString *)extension
+{
+    // <ClassName>.tmp/ or <ClassName>.old/, next to the shard directory
+    return [[self shardDirectoryPath] stringByAppendingPathExtension:extension];
+}
+
+-(void)recoverShardDirectory
+{
+    // A new layout that was still being written is dropped. If we crashed between setting the old shards aside and moving the new ones into place, the old ones are put back; once the new ones are in place, they're just removed.
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    NSString *shardDirectory   = [self shardDirectoryPath];
+    NSString *oldDirectory     = [self shardDirectoryPathWithExtension:@"old"];
+    [fileManager removeItemAtPath:[self shardDirectoryPathWithExtension:@"tmp"] error:nil];
+    if (![fileManager fileExistsAtPath:shardDirectory] && [fileManager fileExistsAtPath:oldDirectory])
+        rename([oldDirectory fileSystemRepresentation], [shardDirectory fileSystemRepresentation]);
+    else
+        [fileManager removeItemAtPath:oldDirectory error:nil];
+}
+
+-(BOOL)replaceShardDirectoryWithDirectoryAtPath:(NSString *)path
+{
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    NSString *shardDirectory   = [self shardDirectoryPath];
+    NSString *oldDirectory     = [self shardDirectoryPathWithExtension:@"old"];
+    [fileManager removeItemAtPath:oldDirectory error:nil];
+
+    // Set the old shards aside (a directory can't be renamed over one that isn't empty), and move the new ones into place. If that fails, put the old ones back.
+    if (rename([shardDirectory fileSystemRepresentation], [oldDirectory fileSystemRepresentation]) != 0 && errno != ENOENT)
+        return NO;
+    if (rename([path fileSystemRepresentation], [shardDirectory fileSystemRepresentation]) != 0)
+    {
+        rename([oldDirectory fileSystemRepresentation], [shardDirectory fileSystemRepresentation]);
+        return NO;
+    }
+
+    // Make sure the switch is on disk before the old layout's files go
+    if (!GRLocalSourceSyncPath([shardDirectory stringByDeletingLastPathComponent]))
+        return NO;
+
+    [fileManager removeItemAtPath:oldDirectory error:nil];
+    return YES;
+}
+
+-(BOOL)removeShardDirectory
+{
+    // Rename the shards out of the way in one step, as removing them file by file could leave some behind to be loaded as the store. <ClassName>.tmp/ is dropped on launch if we crash before it's removed.
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    NSString *removedDirectory = [self shardDirectoryPathWithExtension:@"tmp"];
+    [fileManager removeItemAtPath:removedDirectory error:nil];
+    if (rename([[self shardDirectoryPath] fileSystemRepresentation], [removedDirectory fileSystemRepresentation]) != 0)
+        return errno == ENOENT;
+    if (!GRLocalSourceSyncPath([removedDirectory stringByDeletingLastPathComponent]))
+        return NO;
+
+    [fileManager removeItemAtPath:removedDirectory error:nil];
+    return YES;
+}
+
+-(NSString *)journalPath
+{
+    // <ClassName>.journal, next to the store file
+    return [[[self storePathForFormat:GRLocalSourceStoreFormatJSON] stringByDeletingPathExtension] stringByAppendingPathExtension:@"journal"];
 }
 
 @end
+
+#pragma mark - Commit changes
+
+@implementation GRLocalSourceCommitChanges
+
+-(void)addChanges:(GRLocalSourceCommitChanges *)changes
+{
+    [self.objects unionOrderedSet:changes.objects];
+    [self.deletedUniqueIdentifiers unionOrderedSet:changes.deletedUniqueIdentifiers];
+    [self.shards addIndexes:changes.shards];
+    self.changeCount          += changes.changeCount;
+    self.journaledChangeCount += changes.journaledChangeCount;
+}
+
+@end
+
+#pragma mark - Hashing, syncing & journal encoding
+
+static uint32_t GRLocalSourceHash(const uint8_t *bytes, NSUInteger length)
+{
+    // FNV-1a: cheap, stable across launches (unlike -hash) for assigning shards, and enough to tell a torn or damaged journal entry from a good one
+    uint32_t hash = 2166136261u;
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static BOOL GRLocalSourceSyncPath(NSString *path)
+{
+    // Flush a file's contents, or a directory's entries, to disk
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    if (fd < 0)
+        return NO;
+
+    BOOL synced = fsync(fd) == 0;
+    close(fd);
+
+    return synced;
+}
+
+static void GRLocalSourceJournalAppendUInt32(NSMutableData *data, uint32_t value)
+{
+    value = CFSwapInt32HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static BOOL GRLocalSourceJournalReadUInt32(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, uint32_t *value)
+{
+    if (length - *offset < sizeof(*value))
+        return NO;
+
+    memcpy(value, bytes + *offset, sizeof(*value));
+    *value   = CFSwapInt32LittleToHost(*value);
+    *offset += sizeof(*value);
+
+    return YES;
+}
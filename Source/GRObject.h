@@ -55,10 +55,42 @@
 /* By default, this method deregisters the object with its source. As the source holds a strong reference to the object, this can cause the object to be deallocated if no one holds a pointer to it. You can override this method in your subclass to provide custom behaviour. Generally you should call `[super remove]` in your implementation to deregister the object. However, if you want to implement psuedo-deletion, for example by setting a 'removed' property to YES, you should not call super. */
 -(void)remove;
 
+///
+/// Change tracking
+///
+
+/* The names of the class' properties that are tracked for changes: every property except the metadata properties. This is worked out from the runtime once per class and cached, so it's cheap to call. */
++(NSArray *)observableProperties;
+
+/* Whether instances coalesce their property changes. Returns NO by default, so every property change immediately sets `updateDate` and notifies the source. Override this in your subclass to return YES if you change many properties in quick succession (for example in import loops): each object then only records which properties changed, and the source applies the changes to all dirty objects at once, at the end of the run loop turn or when `-flushChanges` is called on the source. Until then, `updateDate` still has its old value and observers haven't been notified. Looking objects up by an indexed property (see `+indexedProperties`) flushes the changes first, so it always sees the new values. */
++(BOOL)coalescesChanges;
+
+/* Whether instances track property changes by hooking the class' setters rather than with key-value observing. Returns NO by default. Override this in your subclass to return YES to avoid the cost of registering (and removing) a KVO observer for every property of every instance: the setters of the class are then replaced once, the first time an instance is created, with ones that also notify the object of the change. Properties with struct or other unusual types are still observed with KVO. Note that only changes made through the setter (including KVC) are seen, not changes made to instance variables directly. */
++(BOOL)observesChangesWithSetterHooks;
+
+/* Called by the source when it flushes the changes of an object that coalesces its changes. Sets `updateDate` and notifies the source of every property that changed since the last flush. You shouldn't need to call this yourself.
+ @param updateDate The date to use as the object's new `updateDate`
+ */
+-(void)flushChangesWithUpdateDate:(NSDate *)updateDate;
+
 ///
 /// Relationships
 ///
 
+/* The names of properties the source should keep a hash index on. Returns an empty array by default. Override this in your subclass to return the properties you often query by equality, especially relationship properties. For example, if MYPost has an `author` property:
+
+    +(NSArray *)indexedProperties
+    {
+        return @[ @"author" ];
+    }
+
+ then `[user relationship:@"author" ofClass:[MYPost class]]`, and any GRCollection with a predicate like `author == %@` or `author.uniqueIdentifier == %@`, will look up the user's posts directly rather than scanning every post. Relationship properties are indexed by the related object's uniqueIdentifier, other properties by their value, which must be usable as a dictionary key.
+ */
++(NSArray *)indexedProperties;
+
+/* Whether a source that stores objects on disk creates them only when they're first needed. Returns NO by default. Override this in your subclass to return YES if the class has a lot of objects and launch time matters: a GRLocalSource using the binary store format then maps its store file into memory and registers a fault per object (see GRSource), decoding each object the first time it's looked up. Note that `objects` and queries need every object, so they fire all the faults. */
++(BOOL)loadsLazily;
+
 /* Relationships in Gravy are child to parent, where the child holds a reference to the parent object. If a parent needs to access its children, it can call this method to recieve an array of its children. For example, given a MYUser object that has a to-many relationship with the MYPost class:
  
     NSArray *currentUserPosts = [user relationship:@"author" ofClass:[MYPost class]];
@@ -100,6 +132,11 @@ extern NSString * const GRObjectChangesTimestampKey;
  */
 -(void)notifyUpdatedObject:(GRObject *)object withChangedKeyPath:(NSString *)changedKeyPath;
 
+/* Notifies the receiver that an object which coalesces its changes has unflushed changes. The receiver should call `-flushChangesWithUpdateDate:` on the object later, once, however many changes it makes in the meantime.
+ @param object The object that changed
+ */
+-(void)notifyDirtyObject:(GRObject *)object;
+
 /* Deregisters the GRObject with the receiver. The receiver should release its reference to the object.
  @param object The object to deregister
  */
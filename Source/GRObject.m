@@ -14,6 +14,15 @@
 NSString * const GRObjectChangesChangeKey = @"change";
 NSString * const GRObjectChangesTimestampKey = @"timestamp";
 
+/* The observable properties of each class, keyed by class. Classes don't change at runtime, so these are computed once. */
+static NSMutableDictionary *observablePropertiesByClass = nil;
+
+/* The observable properties of each class whose setters have been hooked (see +installSetterHooks), keyed by class. */
+static NSMutableDictionary *hookedPropertiesByClass = nil;
+
+/* The setters that have been hooked, as "Class-setter:" strings, so no setter is hooked twice. */
+static NSMutableSet *hookedSetters = nil;
+
 @interface GRObject ()
 
 @property (strong, nonatomic) NSString *uniqueIdentifier;
@@ -23,6 +32,16 @@ NSString * const GRObjectChangesTimestampKey = @"timestamp";
 @end
 
 @implementation GRObject
+{
+    // The properties changed since the last flush, for classes that coalesce changes. This is an ivar rather than a property so it isn't observed or serialized.
+    NSMutableSet *_dirtyKeyPaths;
+
+    // Whether observeChanges has been called, so we only remove observers we added and hooked setters ignore changes made while initializing
+    BOOL _observesChanges;
+
+    // Whether this object uses setter hooks. Hooks are installed on the class that implements a setter, so instances of superclasses that use KVO can run through them too.
+    BOOL _observesChangesWithSetterHooks;
+}
 
 -(id)init
 {
@@ -48,8 +67,7 @@ NSString * const GRObjectChangesTimestampKey = @"timestamp";
 +(instancetype)objectWithUniqueIdentifier:(NSString *)uniqueIdentifier
 {
     // Return the object that matches the uniqueIdentifier, or nil if none match
-    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"uniqueIdentifier == %@", uniqueIdentifier];
-    return [[[[self source] objects] filteredArrayUsingPredicate:predicate] lastObject];
+    return (id)[[self source] objectWithUniqueIdentifier:uniqueIdentifier];
 }
 
 -(void)save
@@ -75,32 +93,98 @@ NSString * const GRObjectChangesTimestampKey = @"timestamp";
 -(void)dealloc
 {
     // We must remove observers in -dealloc, even on ARC.
-    [self removeObservers];
+    if (_observesChanges)
+        [self removeObservers];
 }
 
 #pragma mark - Observing changes
 
 -(NSArray *)observableProperties
 {
-    // Returns an array of all properties except metadata
-    NSMutableArray *allProperties = [[[self class] propertiesOfType:nil] mutableCopy];
-    [allProperties removeObject:@"uniqueIdentifier"];
-    [allProperties removeObject:@"updateDate"];
-    [allProperties removeObject:@"creationDate"];
-    [allProperties removeObject:@"changes"];
+    return [[self class] observableProperties];
+}
+
++(NSArray *)observableProperties
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        observablePropertiesByClass = [NSMutableDictionary dictionary];
+    });
 
-    return [allProperties copy];
+    @synchronized(observablePropertiesByClass)
+    {
+        // Return the cached list if we've seen this class before
+        NSArray *observableProperties = observablePropertiesByClass[self];
+        if (observableProperties)
+            return observableProperties;
+
+        // Otherwise build an array of all properties except metadata
+        NSMutableArray *allProperties = [[self propertiesOfType:nil] mutableCopy];
+        [allProperties removeObject:@"uniqueIdentifier"];
+        [allProperties removeObject:@"updateDate"];
+        [allProperties removeObject:@"creationDate"];
+        [allProperties removeObject:@"changes"];
+
+        observableProperties = [allProperties copy];
+        observablePropertiesByClass[(id<NSCopying>)self] = observableProperties;
+
+        return observableProperties;
+    }
+}
+
+-(NSArray *)keyValueObservedProperties
+{
+    // Properties whose setters are hooked don't need KVO
+    NSArray *observableProperties = [self observableProperties];
+    if (![[self class] observesChangesWithSetterHooks])
+        return observableProperties;
+
+    NSSet *hookedProperties = [[self class] installSetterHooks];
+    NSMutableArray *keyValueObservedProperties = [NSMutableArray array];
+    for (NSString *property in observableProperties)
+        if (![hookedProperties containsObject:property])
+            [keyValueObservedProperties addObject:property];
+
+    return keyValueObservedProperties;
 }
 
 -(void)observeChanges
 {
     // Observe all keypaths except metadata (to update updateDate and notify GRSource of changes)
-    for (NSString *property in [self observableProperties])
+    for (NSString *property in [self keyValueObservedProperties])
         [self addObserver:self forKeyPath:property options:NSKeyValueObservingOptionNew context:nil];
+
+    _observesChanges                = YES;
+    _observesChangesWithSetterHooks = [[self class] observesChangesWithSetterHooks];
 }
 
 -(void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
 {
+    [self propertyDidChange:keyPath];
+}
+
+-(void)setterDidChangeProperty:(NSString *)property
+{
+    // Ignore values set before we start observing (eg. in initWithDictionaryRepresentation:) and changes that KVO already told us about
+    if (_observesChangesWithSetterHooks)
+        [self propertyDidChange:property];
+}
+
+-(void)propertyDidChange:(NSString *)keyPath
+{
+    // If we coalesce changes, just note the keypath and let the source flush us later
+    if ([[self class] coalescesChanges])
+    {
+        if (!_dirtyKeyPaths)
+        {
+            _dirtyKeyPaths = [NSMutableSet set];
+            [[[self class] source] notifyDirtyObject:self];
+        }
+
+        [_dirtyKeyPaths addObject:keyPath];
+        return;
+    }
+
     // Set updateDate
     self.updateDate = [NSDate date];
 
@@ -108,30 +192,160 @@ NSString * const GRObjectChangesTimestampKey = @"timestamp";
     [[[self class] source] notifyUpdatedObject:self withChangedKeyPath:keyPath];
 }
 
++(BOOL)coalescesChanges
+{
+    return NO;
+}
+
+-(void)flushChangesWithUpdateDate:(NSDate *)updateDate
+{
+    // Take the dirty keypaths first, so changes made by observers mark the object dirty again
+    NSSet *dirtyKeyPaths = _dirtyKeyPaths;
+    _dirtyKeyPaths = nil;
+
+    if (![dirtyKeyPaths count])
+        return;
+
+    // Set updateDate once for all the changes
+    self.updateDate = updateDate;
+
+    // Notify external observers
+    for (NSString *keyPath in dirtyKeyPaths)
+        [[[self class] source] notifyUpdatedObject:self withChangedKeyPath:keyPath];
+}
+
 -(void)removeObservers
 {
     // Iterate through each observer in the filteredObservedChanges array and remove it
-    for (NSString *property in [self observableProperties])
+    for (NSString *property in [self keyValueObservedProperties])
         [self removeObserver:self forKeyPath:property context:nil];
 }
 
+#pragma mark - Setter hooks
+
+/* Setter hooks replace per-instance KVO with a change to the class: each observable property's setter is replaced, once per class, with one that calls the original and then tells the object which property changed. Other KVO observers of the object keep working, as KVO's setters call through to ours. Setters with argument types we can't forward without knowing their size (eg. structs) are left alone and observed with KVO. */
+
++(BOOL)observesChangesWithSetterHooks
+{
+    return NO;
+}
+
+// Returns a block that calls the original setter for the given argument type, then reports the change
+#define GRSetterHook(TYPE) \
+    ^(GRObject *object, TYPE value) { \
+        ((void (*)(id, SEL, TYPE))originalImplementation)(object, setter, value); \
+        [object setterDidChangeProperty:property]; \
+    }
+
++(id)setterHookForProperty:(NSString *)property setter:(SEL)setter originalImplementation:(IMP)originalImplementation type:(char)type
+{
+    switch (type)
+    {
+        case '@': return GRSetterHook(id);
+        case '#': return GRSetterHook(Class);
+        case 'c': return GRSetterHook(char);
+        case 'C': return GRSetterHook(unsigned char);
+        case 's': return GRSetterHook(short);
+        case 'S': return GRSetterHook(unsigned short);
+        case 'i': return GRSetterHook(int);
+        case 'I': return GRSetterHook(unsigned int);
+        case 'l': return GRSetterHook(long);
+        case 'L': return GRSetterHook(unsigned long);
+        case 'q': return GRSetterHook(long long);
+        case 'Q': return GRSetterHook(unsigned long long);
+        case 'f': return GRSetterHook(float);
+        case 'd': return GRSetterHook(double);
+        case 'B': return GRSetterHook(bool);
+        default:  return nil;
+    }
+}
+
+#undef GRSetterHook
+
++(NSSet *)installSetterHooks
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        hookedPropertiesByClass = [NSMutableDictionary dictionary];
+        hookedSetters           = [NSMutableSet set];
+    });
+
+    @synchronized(hookedPropertiesByClass)
+    {
+        // Hooks are only installed the first time an instance of the class starts observing changes
+        NSSet *hookedProperties = hookedPropertiesByClass[self];
+        if (hookedProperties)
+            return hookedProperties;
+
+        NSMutableSet *newHookedProperties = [NSMutableSet set];
+        for (NSString *property in [self observableProperties])
+        {
+            SEL setter = [self metadataForProperty:property].setter;
+            Method method = setter ? class_getInstanceMethod(self, setter) : NULL;
+            if (!method)
+                continue;
+
+            // Hook the setter in the class that implements it, so subclasses that inherit it share the hook
+            Class owner = self;
+            while ([owner superclass] && class_getInstanceMethod([owner superclass], setter) == method)
+                owner = [owner superclass];
+
+            if (![owner isSubclassOfClass:[GRObject class]])
+                continue;
+
+            NSString *hookedSetter = [NSString stringWithFormat:@"%@-%@", NSStringFromClass(owner), NSStringFromSelector(setter)];
+            if (![hookedSetters containsObject:hookedSetter])
+            {
+                // Find the type of the setter's argument (skipping type qualifiers like const)
+                char argumentType[256];
+                method_getArgumentType(method, 2, argumentType, sizeof(argumentType));
+                char *type = argumentType;
+                while (*type && strchr("rnNoORV", *type))
+                    type++;
+
+                id hook = [self setterHookForProperty:property setter:setter originalImplementation:method_getImplementation(method) type:*type];
+                if (!hook)
+                    continue;
+
+                method_setImplementation(method, imp_implementationWithBlock(hook));
+                [hookedSetters addObject:hookedSetter];
+            }
+
+            [newHookedProperties addObject:property];
+        }
+
+        hookedPropertiesByClass[(id<NSCopying>)self] = [newHookedProperties copy];
+        return hookedPropertiesByClass[self];
+    }
+}
+
+
++(NSArray *)indexedProperties
+{
+    return @[];
+}
+
++(BOOL)loadsLazily
+{
+    return NO;
+}
+
 -(NSArray *)relationship:(NSString *)property ofClass:(__unsafe_unretained Class)class
 {
-    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"%s.uniqueIdentifier == %@", property, self.uniqueIdentifier];
-    return [GRCollection collectionWithClass:class predicate:predicate].objects;
+    // Ask the destination source directly, which uses its index on the property if it has one
+    return [[class source] objectsWithValue:self.uniqueIdentifier forProperty:property];
 }
 
 #pragma mark - Description
 
 -(NSString *)description
 {
+    // Describe the metadata dates, then the rest of the properties from the cached list
     NSDictionary *properties = [[self class] classProperties];
+    NSArray *describedProperties = [@[ keypath(self.creationDate), keypath(self.updateDate) ] arrayByAddingObjectsFromArray:[[self class] observableProperties]];
     NSMutableString *description = [NSMutableString string];
-    for (NSString *property in properties)
+    for (NSString *property in describedProperties)
     {
-        if ([property isEqualToString:keypath(self.uniqueIdentifier)])
-            continue;
-
         id value       = [self valueForKey:property];
         NSString *type = [properties valueForKey:property];
 
@@ -169,11 +383,8 @@ NSString * const GRObjectChangesTimestampKey = @"timestamp";
 
 -(instancetype)initWithUniqueIndex:(NSDictionary *)uniqueIndex context:(NSString *)context
 {
-    // Create predicate with uniqueIdentifier as
-    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"uniqueIdentifier == %@", uniqueIndex[keypath(self.uniqueIdentifier)]];
-
-    // Return the object with that predicate
-    return [[[[[self class] source] objects] filteredArrayUsingPredicate:predicate] lastObject];
+    // Return the registered object with the indexed uniqueIdentifier
+    return (id)[[[self class] source] objectWithUniqueIdentifier:uniqueIndex[keypath(self.uniqueIdentifier)]];
 }
 
 @end
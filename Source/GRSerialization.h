@@ -61,12 +61,99 @@
 /* Converts the given object to JSON using the options supplied. */
 +(NSData *)JSONWithObject:(id)object options:(NSDictionary *)options;
 
+/* Writes the JSON for the given object to a stream or file descriptor as it is generated, rather than building it in memory first. Use these for large object graphs (eg. a whole store) to keep memory use flat. The stream is opened if it isn't already, and is left open.
+
+ @return NO if writing to the stream or file descriptor failed
+ */
++(BOOL)writeJSONWithObject:(id)object toStream:(NSOutputStream *)stream options:(NSDictionary *)options;
++(BOOL)writeJSONWithObject:(id)object toFileDescriptor:(int)fileDescriptor options:(NSDictionary *)options;
+
+/* Writes a JSON array whose elements are already encoded, eg. objects encoded one at a time with `+JSONWithObject:options:`. This lets you encode objects at one time (or on one thread) and write them at another. */
++(BOOL)writeJSONWithEncodedObjects:(NSArray *)JSONObjects toStream:(NSOutputStream *)stream;
+
 /* Converts the given JSON data to an object of the specified class, using the given options. `class` is optional. */
 +(id)objectWithJSON:(NSData *)JSON class:(Class)class options:(NSDictionary *)options;
 
+/* Reads JSON from a stream and builds objects of the given class while it parses, passing each to the block as soon as it is complete. Unlike `+objectWithJSON:class:options:`, the JSON is never held in memory as a whole, so it can be used to load large files or responses with a constant overhead. The JSON can be an array of objects, a single object, or a payload if `class` is GRObject (see above). The stream is opened if it isn't already, and is left open.
+
+    NSInputStream *stream = [NSInputStream inputStreamWithFileAtPath:path];
+    [GRSerialization enumerateObjectsWithJSONStream:stream class:[MYUser class] options:nil usingBlock:^(MYUser *user, BOOL *stop) {
+        [user save];
+    }];
+
+ @return NO if the stream couldn't be read or didn't contain valid JSON. Objects read before the problem was found will already have been passed to the block.
+ */
++(BOOL)enumerateObjectsWithJSONStream:(NSInputStream *)stream class:(Class)class options:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block;
+
+/* Writes objects of the given class in GRSerialization's compact binary format. The format has a header listing the class' properties, followed by one length-prefixed record of typed values per object, so it's smaller than JSON and much faster to read back. Dates and data are stored natively. Properties are serialized following the same rules (and GRSerializable customizations) as JSON. Each record holds the values of the properties in the header, so for objects that customize their keys or their dictionary representation, each property's value is taken from under the key the object gives it, and keys the object adds that aren't properties aren't stored.
+
+ @param objects The objects to write, all of `class`
+ @param class The class of the objects, which determines the properties that are written
+ @return NO if writing to the stream failed
+ */
++(BOOL)writeBinaryWithObjects:(NSArray *)objects class:(Class)class toStream:(NSOutputStream *)stream options:(NSDictionary *)options;
+
+/* Like `+writeBinaryWithObjects:class:toStream:options:`, but also copies records that are already encoded (see GRBinaryStore's `-recordAtIndex:`) into the output after the objects. The records must come from a store whose properties match the class (see GRBinaryStore's `matchesClass`).
+ */
++(BOOL)writeBinaryWithObjects:(NSArray *)objects records:(NSArray *)records class:(Class)class toStream:(NSOutputStream *)stream options:(NSDictionary *)options;
+
+/* Encodes a single object as a binary record, in the form `+writeBinaryWithObjects:records:class:toStream:options:` copies. This lets you encode objects at one time (or on one thread) and write them at another. */
++(NSData *)binaryRecordWithObject:(id)object class:(Class)class options:(NSDictionary *)options;
+
+/* Reads objects of the given class written by `+writeBinaryWithObjects:class:toStream:options:`, passing each to the block as soon as it's read. Properties are matched by name, so stores written before properties were added or removed can still be read. The stream is opened if it isn't already, and is left open.
+
+ @return NO if the stream couldn't be read or wasn't in the binary format
+ */
++(BOOL)enumerateObjectsWithBinaryStream:(NSInputStream *)stream class:(Class)class options:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block;
+
+/* Payload keys are matched to classes by trying pluralizations of the key against every GRObject subclass. The result is remembered per context, so each key is only inferred once. You can skip inference (or override it) by registering the class for a key yourself:
+
+    [GRSerialization registerClass:[MYUser class] forPayloadKey:@"author" context:nil];
+
+ @param class The class for the key, or nil to remove a registration
+ @param key The payload key, after case conversion
+ @param context The serialization context in which the registration applies, or nil for all contexts
+ */
++(void)registerClass:(Class)class forPayloadKey:(NSString *)key context:(NSString *)context;
+
+/* Forgets every payload class that was inferred (registered classes are kept). Call this if the classes that keys should map to have changed, eg. you've changed a `+correspondsToKey:context:` implementation at runtime. */
++(void)resetInferredPayloadClasses;
+
+@end
+
+/* GRBinaryStore gives random access to the objects in data written by `+writeBinaryWithObjects:class:toStream:options:`. When it's created it reads the header and finds where each record starts, but it only decodes an object when you ask for it. Create it with memory mapped data (NSDataReadingMappedAlways) to open a large store without reading it: only the pages of the records you touch are read from disk.
+ */
+@interface GRBinaryStore : NSObject
+
+/* Returns nil if the data isn't in the binary format. */
+-(instancetype)initWithData:(NSData *)data class:(Class)class options:(NSDictionary *)options;
+
+/* The number of records in the store. */
+@property (nonatomic, readonly) NSUInteger count;
+
+/* The names of the properties in the store's header, in the order they appear in each record. */
+@property (strong, nonatomic, readonly) NSArray *propertyNames;
+
+/* Whether the store's properties are exactly those the class serializes now, in which case its records can be copied as they are (see `+writeBinaryWithObjects:records:class:toStream:options:`). */
+@property (nonatomic, readonly) BOOL matchesClass;
+
+/* Decodes the value of one property of a record, skipping the rest of the record. Returns nil for nil values or properties the store doesn't have. */
+-(id)valueForProperty:(NSString *)property ofRecordAtIndex:(NSUInteger)index;
+
+/* Like `-valueForProperty:ofRecordAtIndex:`, but converts the value to the property's type, as it would be in the object returned by `-objectAtIndex:`. Related objects are looked up in their source. */
+-(id)objectValueForProperty:(NSString *)property ofRecordAtIndex:(NSUInteger)index;
+
+/* Decodes the object in a record. Each call creates a new object. */
+-(id)objectAtIndex:(NSUInteger)index;
+
+/* The encoded bytes of a record. The data points into the store's data, so it's only valid while the store is alive. */
+-(NSData *)recordAtIndex:(NSUInteger)index;
+
 @end
 
 /* The GRSerializable protocol provides methods that your classes can implement to allow and customize serialization. The only required method is initWithDictionaryRepresentation:context:, which asks the class to return an instance given the data derived from JSON. The other methods are optional and allow you to customize the way your objects are serialized.
+
+ GRSerialization works out how to serialize a class once per context and case, and reuses that work for every object of the class. The answers given by `+serializationPlanShouldIncludeProperty:context:`, `+serializationPlanKeyForProperty:context:` and `+propertyForCorrespondingKey:context:` are remembered, so prefer these class methods. `-serializationShouldIncludeProperty:context:` and `-serializationKeyForProperty:context:` are still supported for answers that depend on the state of an instance, but each object is then asked as it's serialized, which is slower.
  */
 
 @protocol GRSerializable
@@ -102,6 +189,20 @@
  */
 -(NSString *)serializationKeyForProperty:(NSString *)property context:(NSString *)context;
 
+/* Called once per context when the serializer works out how to serialize the class. Return whether the property should be included in dictionary representations of every instance. Implement this instead of `-serializationShouldIncludeProperty:context:` when the answer doesn't depend on the instance.
+
+ @param property The name of the property to be added
+ @param context A string representing the reason for the serialization
+ */
++(BOOL)serializationPlanShouldIncludeProperty:(NSString *)property context:(NSString *)context;
+
+/* Called once per context when the serializer works out how to serialize the class. Return the string to use as the key for the given property in dictionary representations of every instance. Implement this instead of `-serializationKeyForProperty:context:` when the answer doesn't depend on the instance.
+
+ @param property The name of the property to be added
+ @param context A string representing the reason for the serialization
+ */
++(NSString *)serializationPlanKeyForProperty:(NSString *)property context:(NSString *)context;
+
 /* Called when the serializer has finished creating a dictionary representation of the object. You can alter the dictionary in this method.
  @param dictionaryRepresentation A generated dictionary that represents the object
  @param context A string representing the reason for the serialization
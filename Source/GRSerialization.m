@@ -7,14 +7,154 @@
 //
 
 #import "GRSerialization.h"
+#include <unistd.h>
 
-// Cached NSDateFormatter for performance
-static NSDateFormatter *dateFormatter;
+// ISO 8601 date conversion
+static NSString * GRSerializationStringWithDate(NSDate *date);
+static NSDate * GRSerializationDateWithString(NSString *string);
+
+// Payload key to class tables, keyed by context (NSNull for no context). Registered classes are set with +registerClass:forPayloadKey:context:, inferred classes are memoized by +objectSubclassWithKey:options:.
+static NSMutableDictionary *registeredPayloadClasses;
+static NSMutableDictionary *inferredPayloadClasses;
+
+// Converted keys, one cache per case. Payloads reuse a small set of keys, so this saves converting the same keys over and over.
+static NSCache *convertedStringCaches[2];
+static NSUInteger const GRSerializationConvertedStringCacheLimit = 2048;
+
+// Compiled serialization plans, keyed by class, then context, then case (NSNull standing in for no context/case)
+static NSMutableDictionary *serializationPlans;
+
+// Size of the buffer GRJSONWriter fills before writing to its stream or file descriptor
+static NSUInteger const GRJSONWriterBufferSize = 64 * 1024;
+
+// Size of the buffer GRJSONReader reads into, and how deeply JSON may nest before GRJSONReader gives up
+static NSUInteger const GRJSONReaderBufferSize = 64 * 1024;
+static NSUInteger const GRJSONReaderMaximumDepth = 512;
+
+// Binary format: the magic bytes and version at the start of every file, how much GRSerialization buffers when reading and writing it, and how deeply values may nest
+static uint8_t const GRBinaryMagic[4] = { 'G', 'R', 'B', 1 };
+static NSUInteger const GRBinaryBufferSize = 64 * 1024;
+static NSUInteger const GRBinaryMaximumDepth = 512;
 
 // Private options keys
 static NSString * const GRSerializationOptionPropertyKey         = @"GRSerializationOptionProperty";
 static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializationOptionDestinationClass";
 
+@class GRSerializationPlanProperty;
+
+/* A converter turns a property value into its JSON-safe form, or back. Each property of a plan has one of each, chosen from its type when the plan is compiled. */
+typedef id (*GRSerializationConverter)(id value, GRSerializationPlanProperty *property, NSDictionary *options);
+
+/* GRSerializationPlan is everything GRSerialization needs to know to convert objects of one class to and from JSON in one context and case: which properties to include, which JSON key each maps to and how to convert each value. It is compiled once and then walked for every object, so per-object work is just getting, converting and setting values.
+
+ Because plans are shared by every object of a class, the class-level GRSerializable customization methods (`+serializationPlanShouldIncludeProperty:context:`, `+serializationPlanKeyForProperty:context:` and `+propertyForCorrespondingKey:context:`) are called once per class, context and property/key. Classes that implement the instance methods instead are asked per object, see usesInstanceHooks. */
+@interface GRSerializationPlan : NSObject
+
+-(id)initWithClass:(Class)planClass context:(NSString *)context serializationCase:(id)serializationCase;
+
+/* The properties to include when converting an object to JSON, in order. */
+@property (strong, nonatomic, readonly) NSArray *properties;
+
+/* Whether objects of the class implement `-serializationShouldIncludeProperty:context:` or `-serializationKeyForProperty:context:`. Their answers may depend on the object, so they can't be compiled into the plan and each object is asked as it's serialized. */
+@property (nonatomic, readonly) BOOL usesInstanceHooks;
+
+/* Returns the property that the given (case converted) JSON key maps to, or nil if the key should be ignored. */
+-(GRSerializationPlanProperty *)propertyForKey:(NSString *)key;
+
+@end
+
+/* GRSerializationPlanProperty describes how one property is converted. */
+@interface GRSerializationPlanProperty : NSObject
+
+/* The name of the property. */
+@property (strong, nonatomic) NSString *name;
+
+/* The key returned by `+serializationPlanKeyForProperty:context:`, or the name. This is the key used in the dictionary passed to `-serializationWillSerializeDictionaryRepresentation:context:`. */
+@property (strong, nonatomic) NSString *serializationKey;
+
+/* The serialization key converted to the plan's case, as it will appear in the JSON. */
+@property (strong, nonatomic) NSString *JSONKey;
+
+/* The declared class of the property, or Nil for primitives and id. */
+@property (strong, nonatomic) Class propertyClass;
+
+/* Converters for Object -> JSON and JSON -> Object. */
+@property (nonatomic) GRSerializationConverter JSONConverter;
+@property (nonatomic) GRSerializationConverter objectConverter;
+
+@end
+
+/* GRBinaryReader reads a binary store from a stream through a fixed size buffer. */
+@interface GRBinaryReader : NSObject
+
+-(id)initWithStream:(NSInputStream *)stream;
+
+/* Whether reading the stream failed or it contained malformed data. */
+@property (nonatomic, readonly) BOOL failed;
+
+/* Reads up to `length` bytes, returning how many were read (less only at the end of the stream). */
+-(NSUInteger)readBytes:(void *)bytes length:(NSUInteger)length;
+-(BOOL)readUInt32:(uint32_t *)value;
+-(NSString *)readString;
+
+/* Returns the bytes of the next record, or nil at the end of the stream. The data is reused for the following record. */
+-(NSData *)readRecord;
+
+@end
+
+// Binary format helpers (defined with the binary format below)
+static void GRBinaryAppendUInt32(NSMutableData *data, uint32_t value);
+static void GRBinaryAppendString(NSMutableData *data, NSString *string);
+static void GRBinaryAppendValue(NSMutableData *data, id value);
+static id GRBinaryReadValue(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, NSUInteger depth);
+static BOOL GRBinarySkipValue(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, NSUInteger depth);
+static BOOL GRBinaryWriteToStream(NSOutputStream *stream, const uint8_t *bytes, NSUInteger length);
+
+@interface GRSerialization ()
+
++(id)objectWithObject:(id)object options:(NSDictionary *)options;
++(NSDictionary *)dictionaryWithObject:(id)object options:(NSDictionary *)options;
++(NSNumber *)numberWithNumber:(NSNumber *)number options:(NSDictionary *)options;
++(NSString *)stringWithData:(NSData *)data options:(NSDictionary *)options;
++(NSString *)stringWithDate:(NSDate *)date options:(NSDictionary *)options;
++(NSDate *)dateWithString:(NSString *)string options:(NSDictionary *)options;
++(NSString *)convertString:(NSString *)string options:(NSDictionary *)options;
++(GRSerializationPlan *)planForClass:(Class)planClass options:(NSDictionary *)options;
++(Class)objectSubclassWithKey:(NSString *)key options:(NSDictionary *)options;
++(id)objectWithBinaryRecord:(const uint8_t *)bytes length:(NSUInteger)length schema:(NSArray *)schema class:(Class)class options:(NSDictionary *)options;
++(NSDictionary *)binaryPropertyOptionsWithOptions:(NSDictionary *)options;
++(void)appendBinaryRecordWithObject:(id)object plan:(GRSerializationPlan *)plan propertyOptions:(NSDictionary *)propertyOptions toData:(NSMutableData *)data;
++(void)appendBinaryRecordWithDictionaryOfObject:(id)object plan:(GRSerializationPlan *)plan propertyOptions:(NSDictionary *)propertyOptions toData:(NSMutableData *)data;
+
+@end
+
+/* GRJSONWriter writes JSON straight from objects to a stream or file descriptor. Rather than converting the whole object graph to Foundation collections first, it walks the graph and writes each value as it goes, through a fixed size buffer. Serializable objects are written property by property from their serialization plan, so memory use is bounded by the largest single value, not by the size of the graph. */
+@interface GRJSONWriter : NSObject
+
+-(id)initWithStream:(NSOutputStream *)stream;
+-(id)initWithFileDescriptor:(int)fileDescriptor;
+
+/* Writes the JSON for an object, using the same rules as +JSONWithObject:options:. */
+-(void)writeObject:(id)object options:(NSDictionary *)options;
+
+/* Writes a JSON array of values that are already encoded as JSON. */
+-(void)writeArrayWithEncodedElements:(NSArray *)elements;
+
+/* Writes out anything left in the buffer. Returns NO if any write failed. */
+-(BOOL)finish;
+
+@end
+
+/* GRJSONReader is GRJSONWriter's counterpart. It parses JSON from a stream through a fixed size buffer and builds serializable objects straight from the tokens, using their serialization plan to map keys to properties and convert values. Each top level object is handed over as soon as it is complete, so only one object's worth of JSON is ever resident. */
+@interface GRJSONReader : NSObject
+
+-(id)initWithStream:(NSInputStream *)stream;
+
+/* Reads an array of objects, a single object or a payload (when `class` is GRObject), passing each object to the block. Returns NO if the stream couldn't be read or the JSON was invalid. */
+-(BOOL)enumerateObjectsWithClass:(Class)class options:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block;
+
+@end
+
 @implementation GRSerialization
 
 #pragma mark - Serialization API
@@ -24,15 +164,51 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
     // Check that a destination clas was not provided (only valid for JSON->Object)
     NSAssert(!options[GRSerializationOptionDestinationClassKey], @"You must not provide a destination class for Object->JSON serialization. It is only used for JSON->Object.");
 
-    // Convert object into JSONObject
-    id JSONObject = [self objectWithObject:object options:options];
+    // Write the JSON into memory, without building an intermediate JSONObject
+    NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+    if (![self writeJSONWithObject:object toStream:stream options:options])
+        return nil;
 
-    // Convert JSONObject into JSON (we don't check the error, it's useless)
-    NSData *JSON = [NSJSONSerialization dataWithJSONObject:JSONObject options:0 error:nil];
+    NSData *JSON = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    [stream close];
 
     return JSON;
 }
 
++(BOOL)writeJSONWithObject:(id)object toStream:(NSOutputStream *)stream options:(NSDictionary *)options
+{
+    NSAssert(!options[GRSerializationOptionDestinationClassKey], @"You must not provide a destination class for Object->JSON serialization. It is only used for JSON->Object.");
+
+    if ([stream streamStatus] == NSStreamStatusNotOpen)
+        [stream open];
+
+    GRJSONWriter *writer = [[GRJSONWriter alloc] initWithStream:stream];
+    [writer writeObject:object options:options];
+
+    return [writer finish];
+}
+
++(BOOL)writeJSONWithEncodedObjects:(NSArray *)JSONObjects toStream:(NSOutputStream *)stream
+{
+    if ([stream streamStatus] == NSStreamStatusNotOpen)
+        [stream open];
+
+    GRJSONWriter *writer = [[GRJSONWriter alloc] initWithStream:stream];
+    [writer writeArrayWithEncodedElements:JSONObjects];
+
+    return [writer finish];
+}
+
++(BOOL)writeJSONWithObject:(id)object toFileDescriptor:(int)fileDescriptor options:(NSDictionary *)options
+{
+    NSAssert(!options[GRSerializationOptionDestinationClassKey], @"You must not provide a destination class for Object->JSON serialization. It is only used for JSON->Object.");
+
+    GRJSONWriter *writer = [[GRJSONWriter alloc] initWithFileDescriptor:fileDescriptor];
+    [writer writeObject:object options:options];
+
+    return [writer finish];
+}
+
 +(id)objectWithJSON:(NSData *)JSON class:(__unsafe_unretained Class)class options:(NSDictionary *)options
 {
     // Convert JSON into JSONObject
@@ -52,6 +228,227 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
     return object;
 }
 
++(BOOL)enumerateObjectsWithJSONStream:(NSInputStream *)stream class:(Class)class options:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block
+{
+    if ([stream streamStatus] == NSStreamStatusNotOpen)
+        [stream open];
+
+    GRJSONReader *reader = [[GRJSONReader alloc] initWithStream:stream];
+
+    return [reader enumerateObjectsWithClass:class options:options usingBlock:block];
+}
+
+#pragma mark - Binary serialization API
+
++(BOOL)writeBinaryWithObjects:(NSArray *)objects class:(Class)class toStream:(NSOutputStream *)stream options:(NSDictionary *)options
+{
+    return [self writeBinaryWithObjects:objects records:nil class:class toStream:stream options:options];
+}
+
++(BOOL)writeBinaryWithObjects:(NSArray *)objects records:(NSArray *)records class:(Class)class toStream:(NSOutputStream *)stream options:(NSDictionary *)options
+{
+    if ([stream streamStatus] == NSStreamStatusNotOpen)
+        [stream open];
+
+    GRSerializationPlan *plan     = [self planForClass:class options:options];
+    NSDictionary *propertyOptions = [self binaryPropertyOptionsWithOptions:options];
+
+    // Header: magic, then the names of the properties in the order their values appear in each record
+    NSMutableData *data = [NSMutableData dataWithCapacity:GRBinaryBufferSize];
+    [data appendBytes:GRBinaryMagic length:sizeof(GRBinaryMagic)];
+    GRBinaryAppendUInt32(data, (uint32_t)[plan.properties count]);
+    for (GRSerializationPlanProperty *property in plan.properties)
+        GRBinaryAppendString(data, property.name);
+
+    for (id object in objects)
+    {
+        @autoreleasepool {
+            // Leave room for the length of the record, and fill it in once we know it
+            NSUInteger recordOffset = [data length];
+            GRBinaryAppendUInt32(data, 0);
+
+            [self appendBinaryRecordWithObject:object plan:plan propertyOptions:propertyOptions toData:data];
+
+            uint32_t recordLength = CFSwapInt32HostToLittle((uint32_t)([data length] - recordOffset - sizeof(uint32_t)));
+            [data replaceBytesInRange:NSMakeRange(recordOffset, sizeof(uint32_t)) withBytes:&recordLength];
+
+            // Write out full buffers as we go
+            if ([data length] >= GRBinaryBufferSize)
+            {
+                if (!GRBinaryWriteToStream(stream, [data bytes], [data length]))
+                    return NO;
+
+                [data setLength:0];
+            }
+        }
+    }
+
+    // Copy the records that are already encoded
+    for (NSData *record in records)
+    {
+        GRBinaryAppendUInt32(data, (uint32_t)[record length]);
+        [data appendData:record];
+
+        if ([data length] >= GRBinaryBufferSize)
+        {
+            if (!GRBinaryWriteToStream(stream, [data bytes], [data length]))
+                return NO;
+
+            [data setLength:0];
+        }
+    }
+
+    return GRBinaryWriteToStream(stream, [data bytes], [data length]);
+}
+
++(NSData *)binaryRecordWithObject:(id)object class:(Class)class options:(NSDictionary *)options
+{
+    NSMutableData *data = [NSMutableData data];
+    [self appendBinaryRecordWithObject:object plan:[self planForClass:class options:options] propertyOptions:[self binaryPropertyOptionsWithOptions:options] toData:data];
+
+    return data;
+}
+
++(NSDictionary *)binaryPropertyOptionsWithOptions:(NSDictionary *)options
+{
+    // If not recursive, serialize properties as indexes, rather than dictionaries
+    if ([options[GRSerializationOptionRecursiveKey] boolValue])
+        return options;
+
+    NSMutableDictionary *newOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+    newOptions[GRSerializationOptionPropertyKey] = @(YES);
+
+    return [newOptions copy];
+}
+
++(void)appendBinaryRecordWithObject:(id)object plan:(GRSerializationPlan *)plan propertyOptions:(NSDictionary *)propertyOptions toData:(NSMutableData *)data
+{
+    // Objects that choose their keys or alter their dictionary representation are encoded from that representation, as the JSON writer does
+    if ((plan.usesInstanceHooks && [object respondsToSelector:@selector(serializationKeyForProperty:context:)]) ||
+        [object respondsToSelector:@selector(serializationWillSerializeDictionaryRepresentation:context:)])
+    {
+        [self appendBinaryRecordWithDictionaryOfObject:object plan:plan propertyOptions:propertyOptions toData:data];
+        return;
+    }
+
+    // Every record has a value for every property in the header, so a property the object leaves out is stored as nil
+    BOOL asksObject = plan.usesInstanceHooks && [object respondsToSelector:@selector(serializationShouldIncludeProperty:context:)];
+    NSString *context = propertyOptions[GRSerializationOptionContextKey];
+
+    for (GRSerializationPlanProperty *property in plan.properties)
+    {
+        if (asksObject && ![object serializationShouldIncludeProperty:property.name context:context])
+        {
+            GRBinaryAppendValue(data, nil);
+            continue;
+        }
+
+        // Dates and data are stored natively, everything else is stored as its JSON-safe value
+        id value = [object valueForKey:property.name];
+        if (value && ![value isKindOfClass:[NSDate class]] && ![value isKindOfClass:[NSData class]])
+            value = property.JSONConverter(value, property, propertyOptions);
+
+        GRBinaryAppendValue(data, value);
+    }
+}
+
++(void)appendBinaryRecordWithDictionaryOfObject:(id)object plan:(GRSerializationPlan *)plan propertyOptions:(NSDictionary *)propertyOptions toData:(NSMutableData *)data
+{
+    // The object's own options, rather than those of a property (which would give us its unique index)
+    NSMutableDictionary *options = [NSMutableDictionary dictionaryWithDictionary:propertyOptions];
+    [options removeObjectForKey:GRSerializationOptionPropertyKey];
+    NSDictionary *dictionaryRepresentation = [self dictionaryWithObject:object options:options];
+
+    // Each property goes in its slot in the header, taken from under the key the object gave it (with the case converted, as in the dictionary). Keys that aren't properties have no slot, so they're left out.
+    BOOL customizesRepresentation = [object respondsToSelector:@selector(serializationWillSerializeDictionaryRepresentation:context:)];
+    BOOL asksKey                  = plan.usesInstanceHooks && [object respondsToSelector:@selector(serializationKeyForProperty:context:)];
+    NSString *context             = options[GRSerializationOptionContextKey];
+    for (GRSerializationPlanProperty *property in plan.properties)
+    {
+        NSString *key = customizesRepresentation ? property.serializationKey : property.JSONKey;
+        if (asksKey)
+            key = [object serializationKeyForProperty:property.name context:context];
+        if (asksKey || customizesRepresentation)
+            key = [self convertString:key options:options];
+
+        GRBinaryAppendValue(data, key ? dictionaryRepresentation[key] : nil);
+    }
+}
+
++(BOOL)enumerateObjectsWithBinaryStream:(NSInputStream *)stream class:(Class)class options:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block
+{
+    if ([stream streamStatus] == NSStreamStatusNotOpen)
+        [stream open];
+
+    GRBinaryReader *reader = [[GRBinaryReader alloc] initWithStream:stream];
+
+    // An empty stream contains no objects
+    uint8_t magic[sizeof(GRBinaryMagic)];
+    NSUInteger magicLength = [reader readBytes:magic length:sizeof(magic)];
+    if (!magicLength)
+        return !reader.failed;
+    if (magicLength != sizeof(magic) || memcmp(magic, GRBinaryMagic, sizeof(magic)))
+        return NO;
+
+    // Match the property names in the header to the class' properties
+    uint32_t propertyCount;
+    if (![reader readUInt32:&propertyCount])
+        return NO;
+
+    GRSerializationPlan *plan = [self planForClass:class options:options];
+    NSMutableArray *schema    = [NSMutableArray arrayWithCapacity:propertyCount];
+    for (uint32_t i = 0; i < propertyCount; i++)
+    {
+        NSString *name = [reader readString];
+        if (!name)
+            return NO;
+
+        [schema addObject:(id)[plan propertyForKey:name] ?: [NSNull null]];
+    }
+
+    NSMutableDictionary *objectOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+    objectOptions[GRSerializationOptionDestinationClassKey] = class;
+
+    // Read each record and pass its object to the block
+    BOOL stop = NO;
+    NSData *record;
+    while (!stop && (record = [reader readRecord]))
+    {
+        @autoreleasepool {
+            id object = [self objectWithBinaryRecord:[record bytes] length:[record length] schema:schema class:class options:objectOptions];
+            if (!object)
+                return NO;
+
+            block(object, &stop);
+        }
+    }
+
+    return !reader.failed;
+}
+
++(id)objectWithBinaryRecord:(const uint8_t *)bytes length:(NSUInteger)length schema:(NSArray *)schema class:(Class)class options:(NSDictionary *)options
+{
+    NSMutableDictionary *dictionaryRepresentation = [NSMutableDictionary dictionaryWithCapacity:[schema count]];
+
+    NSUInteger offset = 0;
+    for (GRSerializationPlanProperty *property in schema)
+    {
+        id value = GRBinaryReadValue(bytes, length, &offset, 0);
+        if (!value)
+            return nil;
+
+        // Skip properties the class no longer has, and nil values
+        if (property == (id)[NSNull null] || value == [NSNull null])
+            continue;
+
+        id newValue = property.objectConverter(value, property, options);
+        if (newValue)
+            dictionaryRepresentation[property.name] = newValue;
+    }
+
+    return [[class alloc] initWithDictionaryRepresentation:dictionaryRepresentation context:options[GRSerializationOptionContextKey]];
+}
+
 #pragma mark - Conversion to/from JSONObject
 
 /* Converting to JSONObject is pretty easy. We just need to recursively ensure that every value is either an NSDictionary, NSArray, NSString or NSNumber. Converting from JSONObject is harder, mainly because JSON carries no data about class. We solve this problem in three possible ways:
@@ -203,42 +600,78 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
         return [object uniqueIndexWithContext:options[GRSerializationOptionContextKey]];
     }
 
+    // Get the compiled plan for this object's class
+    GRSerializationPlan *plan = [self planForClass:[object class] options:options];
+
+    // If not recursive, serialize properties as indexes, rather than dictionaries
+    NSDictionary *propertyOptions = options;
+    if (![options[GRSerializationOptionRecursiveKey] boolValue])
+    {
+        NSMutableDictionary *newOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+        newOptions[GRSerializationOptionPropertyKey] = @(YES);
+        propertyOptions = [newOptions copy];
+    }
+
+    // Objects that customize their dictionary representation get it with their serialization keys, and we convert the case afterwards
+    BOOL customizesRepresentation = [object respondsToSelector:@selector(serializationWillSerializeDictionaryRepresentation:context:)];
+    BOOL includeNull = [options[GRSerializationOptionIncludeNullKey] boolValue];
+    BOOL convertsCase = options[GRSerializationOptionCaseKey] != nil;
+    NSString *context = options[GRSerializationOptionContextKey];
+
     // Create a dictionaryRepresentation of the object and add each property
-    NSMutableDictionary *dictionaryRepresentation = [NSMutableDictionary dictionary];
-    for (NSString __strong *property in [[object class] propertiesOfType:nil])
+    NSMutableDictionary *dictionaryRepresentation = [NSMutableDictionary dictionaryWithCapacity:[plan.properties count]];
+    for (GRSerializationPlanProperty *property in plan.properties)
     {
-        // If this property is ignored, continue
-        if ([object respondsToSelector:@selector(serializationShouldIncludeProperty:context:)])
-            if (![object serializationShouldIncludeProperty:property context:options[GRSerializationOptionContextKey]])
+        // Objects that customize their properties themselves decide which to include and which keys to use
+        NSString *key = customizesRepresentation ? property.serializationKey : property.JSONKey;
+        if (plan.usesInstanceHooks)
+        {
+            if ([object respondsToSelector:@selector(serializationShouldIncludeProperty:context:)] &&
+                ![object serializationShouldIncludeProperty:property.name context:context])
                 continue;
 
+            if ([object respondsToSelector:@selector(serializationKeyForProperty:context:)])
+            {
+                key = [object serializationKeyForProperty:property.name context:context];
+                if (!customizesRepresentation)
+                    key = [self convertString:key options:options];
+            }
+        }
+
         // Get the value of the property
-        id value = [object valueForKey:property];
+        id value = [object valueForKey:property.name];
 
         // We only include a nil value if the GRSerializationOptionIncludeNull option is given
-        // For primitive types we must include it because we can't differentiate between a 0 and a nil
-        if (![value respondsToSelector:@selector(objCType)] && [options[GRSerializationOptionIncludeNullKey] boolValue] && !value)
-            value = [NSNull null];
-
-        // If not recursive, serialize property as index, rather than dictionary
-        if (![options[GRSerializationOptionRecursiveKey] boolValue])
+        // Primitive types are always boxed, so they are always included
+        if (!value)
         {
-            NSMutableDictionary *propertyOptions = [NSMutableDictionary dictionaryWithDictionary:options];
-            propertyOptions[GRSerializationOptionPropertyKey] = @(YES);
-            value = [self objectWithObject:value options:propertyOptions];
+            if (!includeNull)
+                continue;
+
+            value = [NSNull null];
         }
+        else
+        {
+            value = property.JSONConverter(value, property, propertyOptions);
 
-        // Set the serialization key for the property
-        if ([object respondsToSelector:@selector(serializationKeyForProperty:context:)])
-            property = [object serializationKeyForProperty:property context:options[GRSerializationOptionContextKey]];
+            // Indexes and collections may contain keys of their own, which need their case converted too
+            if (convertsCase && !customizesRepresentation &&
+                ([value isKindOfClass:[NSDictionary class]] || [value isKindOfClass:[NSArray class]]))
+            {
+                value = [self objectWithObject:value options:options];
+            }
+        }
 
         // Set the key value pair on the dictionary representation
-        [dictionaryRepresentation setValue:value forKey:property];
+        if (value)
+            dictionaryRepresentation[key] = value;
     }
 
+    if (!customizesRepresentation)
+        return [dictionaryRepresentation copy];
+
     // Notify object of impending serialization
-    if ([object respondsToSelector:@selector(serializationWillSerializeDictionaryRepresentation:context:)])
-        [object serializationWillSerializeDictionaryRepresentation:&dictionaryRepresentation context:options[GRSerializationOptionContextKey]];
+    [object serializationWillSerializeDictionaryRepresentation:&dictionaryRepresentation context:options[GRSerializationOptionContextKey]];
 
     // JSONify the dictionary (this converts key cases, converts unsupported values)
     NSDictionary *JSONDictionary = [self objectWithObject:dictionaryRepresentation options:options];
@@ -253,7 +686,7 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
 
 +(NSString *)stringWithDate:(NSDate *)date options:(NSDictionary *)options
 {
-    return [[self uniformDateFormatter] stringFromDate:date];
+    return GRSerializationStringWithDate(date);
 }
 
 +(NSString *)stringWithClass:(Class)class options:(NSDictionary *)options
@@ -263,36 +696,33 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
 
 +(NSNumber *)numberWithNumber:(NSNumber *)number options:(NSDictionary *)options
 {
-    // Return an NSNumber for NSNumber objects and C primitives
-    NSString *type = [NSString stringWithCString:[number objCType] encoding:NSUTF8StringEncoding];
-
-    if ([type isEqualToString:@"i"])
-        return @([number integerValue]);
-    else if ([type isEqualToString:@"I"])
-        return @([number unsignedIntegerValue]);
-    else if ([type isEqualToString:@"l"])
-        return @([number longValue]);
-    else if ([type isEqualToString:@"L"])
-        return @([number unsignedLongValue]);
-    else if ([type isEqualToString:@"q"])
-        return @([number longLongValue]);
-    else if ([type isEqualToString:@"Q"])
-        return @([number unsignedLongLongValue]);
-    else if ([type isEqualToString:@"s"])
-        return @([number shortValue]);
-    else if ([type isEqualToString:@"S"])
-        return @([number unsignedShortValue]);
-    else if ([type isEqualToString:@"c"])
-        return @([number boolValue]);
-    else if ([type isEqualToString:@"d"])
-        return @([number doubleValue]);
-    else if ([type isEqualToString:@"f"])
-        return @([number floatValue]);
-    else
+    // Return an NSNumber for NSNumber objects and C primitives. Numbers are immutable, so any number of a supported type is returned as is.
+    switch ([number objCType][0])
     {
-        [NSException raise:@"Incompatible type in GRSerialization"
-                    format:@"Invalid type: %s. GRSerialization can only serialize the following primitive types (even boxed as NSNumbers): signed and unsigned (integers, longs, longlongs, shorts), floats, doubles and BOOLs. This includes typedefs like NSInteger, NSUInteger and CGFloat. Chars are not supported.", [number objCType]];
-        return nil;
+        case 'i':
+        case 'I':
+        case 'l':
+        case 'L':
+        case 'q':
+        case 'Q':
+        case 's':
+        case 'S':
+        case 'd':
+        case 'f':
+            return number;
+
+        case 'c':
+        case 'B':
+            // BOOLs are returned as the shared @(YES) and @(NO), which JSON writes as true and false
+            if (number == (__bridge id)kCFBooleanTrue || number == (__bridge id)kCFBooleanFalse)
+                return number;
+
+            return (__bridge NSNumber *)([number boolValue] ? kCFBooleanTrue : kCFBooleanFalse);
+
+        default:
+            [NSException raise:@"Incompatible type in GRSerialization"
+                        format:@"Invalid type: %s. GRSerialization can only serialize the following primitive types (even boxed as NSNumbers): signed and unsigned (integers, longs, longlongs, shorts), floats, doubles and BOOLs. This includes typedefs like NSInteger, NSUInteger and CGFloat. Chars are not supported.", [number objCType]];
+            return nil;
     }
 }
 
@@ -311,94 +741,108 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
         return [[destinationClass alloc] initWithUniqueIndex:dictionary context:options[GRSerializationOptionContextKey]];
     }
 
-    // Use the class information of the properties to create a full representation of the object.
-    NSDictionary *classProperties = [destinationClass classProperties];
-
-    // Create a dictionary with the keys converted and cross-check it against the destination class' properties.
-    NSMutableDictionary *dictionaryRepresentation = [NSMutableDictionary dictionary];
-    for (NSString __strong *key in dictionary)
-    {
-        // Check if the class responds to the key
-        if (![destinationClass instancesRespondToSelector:NSSelectorFromString(key)])
-        {
-            // If it doesn't, get the corresponding property or ignore it
-            if ([destinationClass instancesRespondToSelector:@selector(propertyForCorrespondingKey:context:)])
-                key = [destinationClass propertyForCorrespondingKey:key context:options[GRSerializationOptionContextKey]];
-            else
-                continue;
-        }
+    // The plan maps each key to a property of the destination class and knows how to convert its value
+    GRSerializationPlan *plan = [self planForClass:destinationClass options:options];
 
-        // Get the type of the property corresponding to this key
-        NSString *type = [classProperties valueForKey:key];
+    // Create a dictionary with the keys mapped to the destination class' properties and the values converted
+    NSMutableDictionary *dictionaryRepresentation = [NSMutableDictionary dictionaryWithCapacity:[dictionary count]];
+    [dictionary enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
 
-        // Get the value of the property
-        id value = [self propertyWithValue:[dictionary valueForKey:key] type:type options:options];
+        // Ignore keys that don't correspond to a property, and null values
+        GRSerializationPlanProperty *property = [plan propertyForKey:key];
+        if (!property || value == [NSNull null])
+            return;
 
-        // Set the value on the new dictionary representation
-        [dictionaryRepresentation setValue:value forKey:key];
-    }
+        // Convert the value and set it on the new dictionary representation
+        id newValue = property.objectConverter(value, property, options);
+        if (newValue)
+            dictionaryRepresentation[property.name] = newValue;
+    }];
 
     // Return an object with the dictionary representation
     return [[destinationClass alloc] initWithDictionaryRepresentation:dictionaryRepresentation context:options[GRSerializationOptionContextKey]];
 }
 
-+(id)propertyWithValue:(id)value type:(NSString *)type options:(NSDictionary *)options
++(NSDate *)dateWithString:(NSString *)string options:(NSDictionary *)options
 {
-    // Convert the given properties from JSON-safe to normal objects
-    if ([NSClassFromString(type) conformsToProtocol:@protocol(GRSerializable)])
-    {
-        // Serialize the object with its class as the destination class
-        NSMutableDictionary *newOptions = [NSMutableDictionary dictionaryWithDictionary:options];
-        newOptions[GRSerializationOptionDestinationClassKey] = NSClassFromString(type);
-        newOptions[GRSerializationOptionPropertyKey] = @(YES);
+    return GRSerializationDateWithString(string);
+}
 
-        return [self objectWithObject:value options:[newOptions copy]];
-    }
-    else if ([NSClassFromString(type) isSubclassOfClass:[NSArray class]] ||
-             [NSClassFromString(type) isSubclassOfClass:[NSDictionary class]])
+#pragma mark - Serialization plans
+
++(GRSerializationPlan *)planForClass:(Class)planClass options:(NSDictionary *)options
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        serializationPlans = [NSMutableDictionary dictionary];
+    });
+
+    id context           = options[GRSerializationOptionContextKey] ?: [NSNull null];
+    id serializationCase = options[GRSerializationOptionCaseKey] ?: [NSNull null];
+
+    @synchronized(serializationPlans)
     {
-        // Recursively serialize property without class information
-        NSMutableDictionary *newOptions = [NSMutableDictionary dictionaryWithDictionary:options];
-        [newOptions removeObjectForKey:GRSerializationOptionDestinationClassKey];
-        id newValue = [self objectWithObject:value options:newOptions];
+        // Find or create the tables for this class and context
+        NSMutableDictionary *plansByContext = serializationPlans[planClass];
+        if (!plansByContext)
+        {
+            plansByContext = [NSMutableDictionary dictionary];
+            serializationPlans[(id<NSCopying>)planClass] = plansByContext;
+        }
 
-        // Make mutable if neccesary
-        if ([NSClassFromString(type) isSubclassOfClass:[NSMutableArray class]] ||
-            [NSClassFromString(type) isSubclassOfClass:[NSMutableDictionary class]])
+        NSMutableDictionary *plansByCase = plansByContext[context];
+        if (!plansByCase)
         {
-            newValue = [newValue mutableCopy];
+            plansByCase = [NSMutableDictionary dictionary];
+            plansByContext[context] = plansByCase;
         }
 
-        return newValue;
+        // Compile the plan the first time we see this class, context and case
+        GRSerializationPlan *plan = plansByCase[serializationCase];
+        if (!plan)
+        {
+            plan = [[GRSerializationPlan alloc] initWithClass:planClass context:(context == [NSNull null] ? nil : context) serializationCase:serializationCase];
+            plansByCase[serializationCase] = plan;
+        }
+
+        return plan;
     }
-    else if ([NSClassFromString(type) isSubclassOfClass:[NSData class]])
-    {
-        // Create an NSData from the string
-        id newValue = [value dataUsingEncoding:NSUTF8StringEncoding];
+}
 
-        // Make mutable if neccesary
-        if ([NSClassFromString(type) isSubclassOfClass:[NSMutableData class]])
-            newValue = [newValue mutableCopy];
+#pragma mark - Helpers
 
-        return newValue;
-    }
-    else if ([NSClassFromString(type) isSubclassOfClass:[NSDate class]])
++(Class)objectSubclassWithKey:(NSString *)key options:(NSDictionary *)options
+{
+    id context = options[GRSerializationOptionContextKey] ?: [NSNull null];
+
+    @synchronized([self payloadClasses])
     {
-        // Create an NSDate from the string
-        return [[self uniformDateFormatter] dateFromString:value];
+        // Registered classes take precedence, first for this context, then for any context
+        Class class = registeredPayloadClasses[context][key] ?: registeredPayloadClasses[[NSNull null]][key];
+
+        // Then classes we've already inferred for this key
+        if (!class)
+            class = inferredPayloadClasses[context][key];
+
+        if (class)
+            return class;
     }
-    else if ([NSClassFromString(type) isSubclassOfClass:[NSMutableString class]])
+
+    // Infer the class and remember it for next time
+    Class class = [self inferObjectSubclassWithKey:key options:options];
+
+    @synchronized([self payloadClasses])
     {
-        // Turn NSString into NSMutableString
-        return [value mutableCopy];
+        if (!inferredPayloadClasses[context])
+            inferredPayloadClasses[context] = [NSMutableDictionary dictionary];
+
+        inferredPayloadClasses[context][key] = class;
     }
 
-    return value;
+    return class;
 }
 
-#pragma mark - Helpers
-
-+(Class)objectSubclassWithKey:(NSString *)key options:(NSDictionary *)options
++(Class)inferObjectSubclassWithKey:(NSString *)key options:(NSDictionary *)options
 {
     // Iterate through all subclasses of GRObject
     for (Class subclass in [NSClassFromString(@"GRObject") subclasses])
@@ -423,6 +867,50 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
     return Nil;
 }
 
++(NSMutableDictionary *)payloadClasses
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        registeredPayloadClasses = [NSMutableDictionary dictionary];
+        inferredPayloadClasses   = [NSMutableDictionary dictionary];
+
+        // Loading a bundle can add classes that match keys better, so forget what we've inferred when that happens
+        [[NSNotificationCenter defaultCenter] addObserverForName:NSBundleDidLoadNotification object:nil queue:nil usingBlock:^(NSNotification *notification) {
+            [self resetInferredPayloadClasses];
+        }];
+    });
+
+    // We use the registered table as the lock for both tables
+    return registeredPayloadClasses;
+}
+
++(void)registerClass:(Class)class forPayloadKey:(NSString *)key context:(NSString *)context
+{
+    NSParameterAssert(key);
+
+    id contextKey = context ?: [NSNull null];
+
+    @synchronized([self payloadClasses])
+    {
+        if (!registeredPayloadClasses[contextKey])
+            registeredPayloadClasses[contextKey] = [NSMutableDictionary dictionary];
+
+        // A nil class removes the registration
+        if (class)
+            registeredPayloadClasses[contextKey][key] = class;
+        else
+            [registeredPayloadClasses[contextKey] removeObjectForKey:key];
+    }
+}
+
++(void)resetInferredPayloadClasses
+{
+    @synchronized([self payloadClasses])
+    {
+        [inferredPayloadClasses removeAllObjects];
+    }
+}
+
 #pragma mark - Singularization/Pluralization
 
 +(NSArray *)singularizedCandidatesForKey:(NSString *)key
@@ -508,75 +996,120 @@ static NSString * const GRSerializationOptionDestinationClassKey = @"GRSerializa
 
 +(NSString *)convertString:(NSString *)string toCase:(GRSerializationCase)serializationCase
 {
-    if (serializationCase == GRSerializationCaseLlamaCase)
-    {
-        // "id" is a reserved word in ObjC, so we just replace it with the "identifier".
-        // If your class has an attribute like userId, please use userIdentifier instead.
-        if ([string isEqualToString:@"id"])
-            string = @"identifier";
-        else if ([string hasSuffix:@"_id"])
-            string = [[string substringFromIndex:[string length] - 2] stringByAppendingString:@"Identifier"];
+    if (serializationCase != GRSerializationCaseLlamaCase && serializationCase != GRSerializationCaseSnakeCase)
+        return nil;
 
-        // Find underscores, replace with space and capitalize following letter (eg. "user_name" to "userName"
-        if ([string rangeOfString:@"_"].location != NSNotFound)
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        for (NSUInteger i = 0; i < 2; i++)
         {
-            NSRange rangeOfUnderscore = [string rangeOfString:@"_"];
-
-            while (rangeOfUnderscore.location != NSNotFound)
-            {
-                string = [string stringByReplacingCharactersInRange:rangeOfUnderscore withString:@""];
-                string = [string stringByReplacingCharactersInRange:rangeOfUnderscore withString:[[string substringWithRange:rangeOfUnderscore] uppercaseString]];
-
-                rangeOfUnderscore = [string rangeOfString:@"_"];
-            }
+            convertedStringCaches[i] = [[NSCache alloc] init];
+            convertedStringCaches[i].countLimit = GRSerializationConvertedStringCacheLimit;
         }
+    });
 
-        return string;
-    }
-    else if (serializationCase == GRSerializationCaseSnakeCase)
-    {
-        for (int i = 0; i < string.length - 1; i++)
-        {
-            // Find even capital letter, insert underscore and lowercase the letter
-            if ([[NSCharacterSet uppercaseLetterCharacterSet] characterIsMember:[string characterAtIndex:i]])
-            {
-                // Make replacement string
-                NSString *lowercaseCharacter = [NSString stringWithFormat:@"_%c", [[string lowercaseString] characterAtIndex:i]];
+    // Return the cached conversion if we've seen this key before (NSCache is thread safe and evicts when full)
+    NSCache *cache = convertedStringCaches[serializationCase];
+    NSString *convertedString = [cache objectForKey:string];
+    if (convertedString)
+        return convertedString;
 
-                // Replace uppercase character with underscore and lowercase
-                string = [string stringByReplacingCharactersInRange:NSMakeRange(i, 1) withString:lowercaseCharacter];
-            }
-        }
+    if (serializationCase == GRSerializationCaseLlamaCase)
+        convertedString = [self llamaCaseStringWithString:string];
+    else
+        convertedString = [self snakeCaseStringWithString:string];
 
-        // Convert instances of "identifier" to "id"
-        string = [string stringByReplacingOccurrencesOfString:@"identifier" withString:@"id"];
-        
-        return string;
-    }
+    [cache setObject:convertedString forKey:[string copy]];
 
-    return nil;
+    return convertedString;
 }
 
-#pragma mark - Date conversion
-
-+(NSDateFormatter *)uniformDateFormatter
++(NSString *)llamaCaseStringWithString:(NSString *)string
 {
-    // Return cached dateFormatter if exists
-    if (dateFormatter)
-        return dateFormatter;
+    // "id" is a reserved word in ObjC, so we just replace it with the "identifier".
+    // If your class has an attribute like userId, please use userIdentifier instead.
+    if ([string isEqualToString:@"id"])
+        return @"identifier";
+
+    NSUInteger length = [string length];
+    BOOL identifierSuffix = [string hasSuffix:@"_id"];
+    if (identifierSuffix)
+        length -= 3;
+
+    // Copy the characters into a buffer, dropping underscores and capitalizing the letter following each (eg. "user_name" to "userName")
+    unichar *characters = malloc(sizeof(unichar) * MAX(length, 1));
+    [string getCharacters:characters range:NSMakeRange(0, length)];
+
+    NSUInteger convertedLength = 0;
+    BOOL capitalizeNext = NO;
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        unichar character = characters[i];
 
-    // Cache for performance
-    dateFormatter = [[NSDateFormatter alloc] init];
+        if (character == '_')
+        {
+            capitalizeNext = YES;
+            continue;
+        }
 
-    // Set format (compatible with rails), locale (to avoid discrepancies with client's calendar) and UTC timezone
-    [NSDateFormatter setDefaultFormatterBehavior:NSDateFormatterBehavior10_4];
-    [dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss'Z'"];
-    [dateFormatter setLocale:[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"]];
-    [dateFormatter setTimeZone:[NSTimeZone timeZoneWithName:@"UTC"]];
+        if (capitalizeNext && character >= 'a' && character <= 'z')
+            character -= 'a' - 'A';
 
-    // I love using dates in Objective-C!!! It just works!
-    return dateFormatter;
-}
+        capitalizeNext = NO;
+        characters[convertedLength++] = character;
+    }
+
+    NSMutableString *convertedString = [[NSMutableString alloc] initWithCharactersNoCopy:characters length:convertedLength freeWhenDone:YES];
+
+    // Convert the "_id" suffix to "Identifier" (eg. "user_id" to "userIdentifier")
+    if (identifierSuffix)
+        [convertedString appendString:@"Identifier"];
+
+    return [convertedString copy];
+}
+
++(NSString *)snakeCaseStringWithString:(NSString *)string
+{
+    NSUInteger length = [string length];
+    if (!length)
+        return string;
+
+    // Each character becomes at most two ("A" to "_a")
+    unichar *characters = malloc(sizeof(unichar) * length);
+    unichar *convertedCharacters = malloc(sizeof(unichar) * length * 2);
+    [string getCharacters:characters range:NSMakeRange(0, length)];
+
+    NSCharacterSet *uppercaseLetters = [NSCharacterSet uppercaseLetterCharacterSet];
+    NSUInteger convertedLength = 0;
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        unichar character = characters[i];
+
+        // Find every capital letter, insert underscore and lowercase the letter
+        BOOL ASCIIUppercase = character >= 'A' && character <= 'Z';
+        if (ASCIIUppercase || (character > 0x7F && [uppercaseLetters characterIsMember:character]))
+        {
+            if (convertedLength)
+                convertedCharacters[convertedLength++] = '_';
+
+            if (ASCIIUppercase)
+                character += 'a' - 'A';
+            else
+                character = [[[NSString stringWithCharacters:&character length:1] lowercaseString] characterAtIndex:0];
+        }
+
+        convertedCharacters[convertedLength++] = character;
+    }
+
+    free(characters);
+    NSString *convertedString = [[NSString alloc] initWithCharactersNoCopy:convertedCharacters length:convertedLength freeWhenDone:YES];
+
+    // Convert instances of "identifier" to "id"
+    if ([convertedString rangeOfString:@"identifier"].location != NSNotFound)
+        convertedString = [convertedString stringByReplacingOccurrencesOfString:@"identifier" withString:@"id"];
+
+    return convertedString;
+}
 
 @end
 
@@ -584,3 +1117,1883 @@ NSString * const GRSerializationOptionContextKey          = @"GRSerializationOpt
 NSString * const GRSerializationOptionRecursiveKey        = @"GRSerializationOptionRecursive";
 NSString * const GRSerializationOptionIncludeNullKey      = @"GRSerializationOptionIncludeNull";
 NSString * const GRSerializationOptionCaseKey             = @"GRSerializationOptionCase";
+
+#pragma mark - Date conversion
+
+/* Dates are written in UTC to the second, eg. "2013-01-31T12:34:56Z" (compatible with rails). Any ISO 8601 date and time can be read: the seconds may have a fraction and the time zone may be "Z", an offset ("+10:00", "+1000" or "+10") or missing (UTC). We convert dates by hand, rather than with NSDateFormatter, because it's much faster and we can use it on any thread. */
+
+// Days since 1970-01-01 of a date in the Gregorian calendar, and back (see http://howardhinnant.github.io/date_algorithms.html)
+static int64_t GRSerializationDaysFromCivil(int64_t year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era        = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra  = year - era * 400;
+    int64_t dayOfYear  = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t dayOfEra   = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static void GRSerializationCivilFromDays(int64_t days, int64_t *year, int *month, int *day)
+{
+    days += 719468;
+    int64_t era        = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t dayOfEra   = days - era * 146097;
+    int64_t yearOfEra  = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int64_t dayOfYear  = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+
+    *day   = (int)(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    *month = (int)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    *year  = yearOfEra + era * 400 + (*month <= 2);
+}
+
+static NSString * GRSerializationStringWithDate(NSDate *date)
+{
+    if (!date)
+        return nil;
+
+    // Split the time into days and seconds of the day
+    int64_t seconds     = (int64_t)floor([date timeIntervalSince1970]);
+    int64_t days        = seconds / 86400;
+    int64_t secondOfDay = seconds % 86400;
+    if (secondOfDay < 0)
+    {
+        days--;
+        secondOfDay += 86400;
+    }
+
+    int64_t year;
+    int month, day;
+    GRSerializationCivilFromDays(days, &year, &month, &day);
+
+    char characters[48];
+    int length = snprintf(characters, sizeof(characters), "%04lld-%02d-%02dT%02d:%02d:%02dZ", year, month, day, (int)(secondOfDay / 3600), (int)(secondOfDay / 60 % 60), (int)(secondOfDay % 60));
+
+    return [[NSString alloc] initWithBytes:characters length:length encoding:NSASCIIStringEncoding];
+}
+
+/* Reads `count` digits into `value`, advancing `characters`. Returns NO if there aren't enough digits. */
+static BOOL GRSerializationReadDigits(const char **characters, int count, int *value)
+{
+    *value = 0;
+    for (int i = 0; i < count; i++)
+    {
+        char character = (*characters)[i];
+        if (character < '0' || character > '9')
+            return NO;
+
+        *value = *value * 10 + (character - '0');
+    }
+
+    *characters += count;
+    return YES;
+}
+
+/* The number of days in a month of the proleptic Gregorian calendar. */
+static int GRSerializationDaysInMonth(int64_t year, int month)
+{
+    static const int daysInMonth[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+        return 29;
+
+    return daysInMonth[month - 1];
+}
+
+static NSDate * GRSerializationDateWithString(NSString *string)
+{
+    // Dates are ASCII and short, so we can read them from a buffer on the stack
+    char buffer[64];
+    if (![string isKindOfClass:[NSString class]] || ![string getCString:buffer maxLength:sizeof(buffer) encoding:NSASCIIStringEncoding])
+        return nil;
+
+    const char *characters = buffer;
+
+    // Date: yyyy-MM-dd
+    int year, month, day;
+    if (!GRSerializationReadDigits(&characters, 4, &year) || *characters++ != '-' ||
+        !GRSerializationReadDigits(&characters, 2, &month) || *characters++ != '-' ||
+        !GRSerializationReadDigits(&characters, 2, &day))
+        return nil;
+
+    // Time: THH:mm, then optionally :ss and a fraction of a second
+    int hour = 0, minute = 0, second = 0;
+    double fraction = 0;
+    if (*characters == 'T' || *characters == 't' || *characters == ' ')
+    {
+        characters++;
+        if (!GRSerializationReadDigits(&characters, 2, &hour) || *characters++ != ':' ||
+            !GRSerializationReadDigits(&characters, 2, &minute))
+            return nil;
+
+        if (*characters == ':')
+        {
+            characters++;
+            if (!GRSerializationReadDigits(&characters, 2, &second))
+                return nil;
+
+            if (*characters == '.' || *characters == ',')
+            {
+                characters++;
+                if (*characters < '0' || *characters > '9')
+                    return nil;
+
+                // Keep up to nanoseconds, ignore the rest
+                int64_t numerator = 0, denominator = 1;
+                for (; *characters >= '0' && *characters <= '9'; characters++)
+                {
+                    if (denominator < 1000000000)
+                    {
+                        numerator   = numerator * 10 + (*characters - '0');
+                        denominator *= 10;
+                    }
+                }
+
+                fraction = (double)numerator / denominator;
+            }
+        }
+    }
+
+    // Time zone: Z, +HH:mm, +HHmm, +HH or none (UTC)
+    int offset = 0;
+    if (*characters == 'Z' || *characters == 'z')
+        characters++;
+    else if (*characters == '+' || *characters == '-')
+    {
+        int sign = *characters++ == '-' ? -1 : 1;
+        int offsetHours, offsetMinutes = 0;
+        if (!GRSerializationReadDigits(&characters, 2, &offsetHours))
+            return nil;
+
+        // The minutes are optional, but a colon must be followed by both digits
+        if (*characters == ':')
+        {
+            characters++;
+            if (!GRSerializationReadDigits(&characters, 2, &offsetMinutes))
+                return nil;
+        }
+        else if (*characters && !GRSerializationReadDigits(&characters, 2, &offsetMinutes))
+            return nil;
+
+        if (offsetHours > 23 || offsetMinutes > 59)
+            return nil;
+
+        offset = sign * (offsetHours * 3600 + offsetMinutes * 60);
+    }
+
+    // Reject anything left over and out of range fields. The day must exist in its month, and 24 is only valid as the end of the day (24:00:00).
+    if (*characters || month < 1 || month > 12 || day < 1 || day > GRSerializationDaysInMonth(year, month) || hour > 24 || minute > 59 || second > 60)
+        return nil;
+
+    if (hour == 24 && (minute || second || fraction))
+        return nil;
+
+    int64_t days = GRSerializationDaysFromCivil(year, month, day);
+    NSTimeInterval interval = (double)(days * 86400 + hour * 3600 + minute * 60 + second - offset) + fraction;
+
+    return [NSDate dateWithTimeIntervalSince1970:interval];
+}
+
+#pragma mark - Converters
+
+/* Object -> JSON: values declared as strings can be used as they are. */
+static id GRSerializationConvertStringToJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    if ([value isKindOfClass:[NSString class]])
+        return value;
+
+    return [GRSerialization objectWithObject:value options:options];
+}
+
+/* Object -> JSON: primitives and NSNumbers. */
+static id GRSerializationConvertNumberToJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    if ([value isKindOfClass:[NSNumber class]])
+        return [GRSerialization numberWithNumber:value options:options];
+
+    return [GRSerialization objectWithObject:value options:options];
+}
+
+/* Object -> JSON: dates become formatted strings. */
+static id GRSerializationConvertDateToJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    if ([value isKindOfClass:[NSDate class]])
+        return [GRSerialization stringWithDate:value options:options];
+
+    return [GRSerialization objectWithObject:value options:options];
+}
+
+/* Object -> JSON: data becomes a string. */
+static id GRSerializationConvertDataToJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    if ([value isKindOfClass:[NSData class]])
+        return [GRSerialization stringWithData:value options:options];
+
+    return [GRSerialization objectWithObject:value options:options];
+}
+
+/* Object -> JSON: anything else (collections, serializable objects, id) goes through the general conversion. */
+static id GRSerializationConvertObjectToJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    return [GRSerialization objectWithObject:value options:options];
+}
+
+/* JSON -> Object: strings, numbers and untyped values are used as they are. */
+static id GRSerializationConvertValueFromJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    return value;
+}
+
+/* JSON -> Object: strings for NSMutableString properties. */
+static id GRSerializationConvertMutableStringFromJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    return [value mutableCopy];
+}
+
+/* JSON -> Object: dates are parsed from strings. */
+static id GRSerializationConvertDateFromJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    if (![value isKindOfClass:[NSString class]])
+        return value;
+
+    return [GRSerialization dateWithString:value options:options];
+}
+
+/* JSON -> Object: data is created from strings. */
+static id GRSerializationConvertDataFromJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    // Binary stores keep data as data
+    id newValue = value;
+    if ([value isKindOfClass:[NSString class]])
+        newValue = [value dataUsingEncoding:NSUTF8StringEncoding];
+    else if (![value isKindOfClass:[NSData class]])
+        return value;
+
+    // Make mutable if neccesary
+    if ([property.propertyClass isSubclassOfClass:[NSMutableData class]])
+        newValue = [newValue mutableCopy];
+
+    return newValue;
+}
+
+/* JSON -> Object: collections are serialized recursively without class information. */
+static id GRSerializationConvertCollectionFromJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    NSMutableDictionary *newOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+    [newOptions removeObjectForKey:GRSerializationOptionDestinationClassKey];
+    id newValue = [GRSerialization objectWithObject:value options:newOptions];
+
+    // Make mutable if neccesary
+    if ([property.propertyClass isSubclassOfClass:[NSMutableArray class]] ||
+        [property.propertyClass isSubclassOfClass:[NSMutableDictionary class]])
+    {
+        newValue = [newValue mutableCopy];
+    }
+
+    return newValue;
+}
+
+/* JSON -> Object: serializable objects are serialized with the property's class as the destination class. */
+static id GRSerializationConvertSerializableFromJSON(id value, GRSerializationPlanProperty *property, NSDictionary *options)
+{
+    NSMutableDictionary *newOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+    newOptions[GRSerializationOptionDestinationClassKey] = property.propertyClass;
+    newOptions[GRSerializationOptionPropertyKey] = @(YES);
+
+    return [GRSerialization objectWithObject:value options:[newOptions copy]];
+}
+
+#pragma mark - Serialization plan
+
+@implementation GRSerializationPlanProperty
+@end
+
+@interface GRSerializationPlan ()
+
+@property (strong, nonatomic) Class planClass;
+@property (strong, nonatomic) NSString *context;
+
+/* The properties keyed by name, for every property of the class (not only the included ones). */
+@property (strong, nonatomic) NSDictionary *propertiesByName;
+
+/* The property each JSON key maps to (NSNull for ignored keys), filled in as keys are seen. */
+@property (strong, nonatomic) NSMutableDictionary *propertiesByKey;
+
+@end
+
+@implementation GRSerializationPlan
+
+-(id)initWithClass:(Class)planClass context:(NSString *)context serializationCase:(id)serializationCase
+{
+    if (self = [super init])
+    {
+        _planClass       = planClass;
+        _context         = context;
+        _propertiesByKey = [NSMutableDictionary dictionary];
+
+        // The case options are the only options that affect keys
+        NSDictionary *caseOptions = serializationCase != [NSNull null] ? @{ GRSerializationOptionCaseKey: serializationCase } : nil;
+
+        // Objects that customize their properties themselves are asked one at a time when they're serialized
+        _usesInstanceHooks = [planClass instancesRespondToSelector:@selector(serializationShouldIncludeProperty:context:)] ||
+                             [planClass instancesRespondToSelector:@selector(serializationKeyForProperty:context:)];
+
+        NSMutableArray *properties            = [NSMutableArray array];
+        NSMutableDictionary *propertiesByName = [NSMutableDictionary dictionary];
+        for (GRPropertyMetadata *metadata in [planClass classPropertyMetadata])
+        {
+            GRSerializationPlanProperty *property = [[GRSerializationPlanProperty alloc] init];
+            property.name          = metadata.name;
+            property.propertyClass = metadata.propertyClass;
+            [self chooseConvertersForProperty:property type:metadata.type];
+            propertiesByName[property.name] = property;
+
+            // If this property is ignored, it's only used for JSON -> Object
+            if ([planClass respondsToSelector:@selector(serializationPlanShouldIncludeProperty:context:)] &&
+                ![planClass serializationPlanShouldIncludeProperty:property.name context:context])
+                continue;
+
+            // Set the serialization key for the property, and the JSON key in the right case
+            property.serializationKey = property.name;
+            if ([planClass respondsToSelector:@selector(serializationPlanKeyForProperty:context:)])
+                property.serializationKey = [planClass serializationPlanKeyForProperty:property.name context:context];
+            property.JSONKey = [GRSerialization convertString:property.serializationKey options:caseOptions];
+
+            [properties addObject:property];
+        }
+
+        _properties       = [properties copy];
+        _propertiesByName = [propertiesByName copy];
+    }
+
+    return self;
+}
+
+-(void)chooseConvertersForProperty:(GRSerializationPlanProperty *)property type:(NSString *)type
+{
+    Class propertyClass = property.propertyClass;
+
+    if ([propertyClass conformsToProtocol:@protocol(GRSerializable)])
+    {
+        property.JSONConverter   = GRSerializationConvertObjectToJSON;
+        property.objectConverter = GRSerializationConvertSerializableFromJSON;
+    }
+    else if ([propertyClass isSubclassOfClass:[NSArray class]] || [propertyClass isSubclassOfClass:[NSDictionary class]])
+    {
+        property.JSONConverter   = GRSerializationConvertObjectToJSON;
+        property.objectConverter = GRSerializationConvertCollectionFromJSON;
+    }
+    else if ([propertyClass isSubclassOfClass:[NSData class]])
+    {
+        property.JSONConverter   = GRSerializationConvertDataToJSON;
+        property.objectConverter = GRSerializationConvertDataFromJSON;
+    }
+    else if ([propertyClass isSubclassOfClass:[NSDate class]])
+    {
+        property.JSONConverter   = GRSerializationConvertDateToJSON;
+        property.objectConverter = GRSerializationConvertDateFromJSON;
+    }
+    else if ([propertyClass isSubclassOfClass:[NSMutableString class]])
+    {
+        property.JSONConverter   = GRSerializationConvertStringToJSON;
+        property.objectConverter = GRSerializationConvertMutableStringFromJSON;
+    }
+    else if ([propertyClass isSubclassOfClass:[NSString class]])
+    {
+        property.JSONConverter   = GRSerializationConvertStringToJSON;
+        property.objectConverter = GRSerializationConvertValueFromJSON;
+    }
+    else if ([propertyClass isSubclassOfClass:[NSNumber class]] || (!propertyClass && [type length] && ![type isEqualToString:@"id"]))
+    {
+        // NSNumbers and primitives, which KVC boxes as NSNumbers
+        property.JSONConverter   = GRSerializationConvertNumberToJSON;
+        property.objectConverter = GRSerializationConvertValueFromJSON;
+    }
+    else
+    {
+        property.JSONConverter   = GRSerializationConvertObjectToJSON;
+        property.objectConverter = GRSerializationConvertValueFromJSON;
+    }
+}
+
+-(GRSerializationPlanProperty *)propertyForKey:(NSString *)key
+{
+    @synchronized(self)
+    {
+        // Return what we worked out last time we saw this key
+        id property = self.propertiesByKey[key];
+        if (property)
+            return property == [NSNull null] ? nil : property;
+
+        // The key is either the name of a property or, failing that, the class can tell us which property it corresponds to
+        property = self.propertiesByName[key];
+        if (!property && [self.planClass respondsToSelector:@selector(propertyForCorrespondingKey:context:)])
+        {
+            NSString *correspondingProperty = [self.planClass propertyForCorrespondingKey:key context:self.context];
+            if (correspondingProperty)
+                property = self.propertiesByName[correspondingProperty];
+        }
+
+        self.propertiesByKey[key] = property ?: [NSNull null];
+
+        return property;
+    }
+}
+
+@end
+
+#pragma mark - JSON writer
+
+@implementation GRJSONWriter
+{
+    NSOutputStream *_stream;
+    int _fileDescriptor;
+    uint8_t *_buffer;
+    NSUInteger _length;
+    BOOL _failed;
+}
+
+-(id)initWithStream:(NSOutputStream *)stream
+{
+    if (self = [super init])
+    {
+        _stream         = stream;
+        _fileDescriptor = -1;
+        _buffer         = malloc(GRJSONWriterBufferSize);
+    }
+
+    return self;
+}
+
+-(id)initWithFileDescriptor:(int)fileDescriptor
+{
+    if (self = [super init])
+    {
+        _fileDescriptor = fileDescriptor;
+        _buffer         = malloc(GRJSONWriterBufferSize);
+    }
+
+    return self;
+}
+
+-(void)dealloc
+{
+    free(_buffer);
+}
+
+#pragma mark Output
+
+-(void)writeOutBytes:(const uint8_t *)bytes length:(NSUInteger)length
+{
+    NSUInteger written = 0;
+    while (written < length && !_failed)
+    {
+        NSInteger result;
+        if (_stream)
+            result = [_stream write:bytes + written maxLength:length - written];
+        else
+        {
+            result = write(_fileDescriptor, bytes + written, length - written);
+            if (result < 0 && errno == EINTR)
+                continue;
+        }
+
+        if (result <= 0)
+            _failed = YES;
+        else
+            written += result;
+    }
+}
+
+-(void)flush
+{
+    [self writeOutBytes:_buffer length:_length];
+    _length = 0;
+}
+
+-(void)writeBytes:(const void *)bytes length:(NSUInteger)length
+{
+    if (length > GRJSONWriterBufferSize - _length)
+    {
+        [self flush];
+
+        // Writes bigger than the buffer skip it
+        if (length >= GRJSONWriterBufferSize)
+        {
+            [self writeOutBytes:bytes length:length];
+            return;
+        }
+    }
+
+    memcpy(_buffer + _length, bytes, length);
+    _length += length;
+}
+
+-(void)writeByte:(uint8_t)byte
+{
+    if (_length == GRJSONWriterBufferSize)
+        [self flush];
+
+    _buffer[_length++] = byte;
+}
+
+-(void)writeCString:(const char *)string
+{
+    [self writeBytes:string length:strlen(string)];
+}
+
+-(BOOL)finish
+{
+    [self flush];
+    return !_failed;
+}
+
+#pragma mark Values
+
+-(void)writeObject:(id)object options:(NSDictionary *)options
+{
+    if ([object conformsToProtocol:@protocol(GRSerializable)])
+        [self writeSerializableObject:object options:options];
+    else if ([object isKindOfClass:[NSArray class]])
+        [self writeArray:object options:options];
+    else if ([object isKindOfClass:[NSDictionary class]])
+        [self writeDictionary:object options:options];
+    else if ([object isKindOfClass:[NSString class]])
+        [self writeString:object];
+    else if ([object isKindOfClass:[NSNumber class]])
+        [self writeNumber:[GRSerialization numberWithNumber:object options:options]];
+    else if (!object || [object isKindOfClass:[NSNull class]])
+        [self writeCString:"null"];
+    else
+    {
+        // Dates, data and classes are converted to strings
+        id JSONObject = [GRSerialization objectWithObject:object options:options];
+        if (![JSONObject isKindOfClass:[NSString class]])
+            [NSException raise:NSInvalidArgumentException format:@"Invalid type in JSON write (%@)", NSStringFromClass([object class])];
+
+        [self writeString:JSONObject];
+    }
+}
+
+-(void)writeSerializableObject:(id)object options:(NSDictionary *)options
+{
+    // Indexes and objects that customize their dictionary representation are written from their dictionary
+    if ((options[GRSerializationOptionPropertyKey] && ![options[GRSerializationOptionRecursiveKey] boolValue] && [object respondsToSelector:@selector(uniqueIndexWithContext:)]) ||
+        [object respondsToSelector:@selector(serializationWillSerializeDictionaryRepresentation:context:)])
+    {
+        [self writeObject:[GRSerialization dictionaryWithObject:object options:options] options:options];
+        return;
+    }
+
+    // So are objects that choose their properties and keys themselves
+    GRSerializationPlan *plan = [GRSerialization planForClass:[object class] options:options];
+    if (plan.usesInstanceHooks)
+    {
+        [self writeObject:[GRSerialization dictionaryWithObject:object options:options] options:options];
+        return;
+    }
+
+    // If not recursive, serialize properties as indexes, rather than dictionaries
+    NSDictionary *propertyOptions = options;
+    if (![options[GRSerializationOptionRecursiveKey] boolValue])
+    {
+        NSMutableDictionary *newOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+        newOptions[GRSerializationOptionPropertyKey] = @(YES);
+        propertyOptions = [newOptions copy];
+    }
+
+    BOOL includeNull = [options[GRSerializationOptionIncludeNullKey] boolValue];
+    BOOL first       = YES;
+
+    [self writeByte:'{'];
+    for (GRSerializationPlanProperty *property in plan.properties)
+    {
+        id value = [object valueForKey:property.name];
+        if (!value && !includeNull)
+            continue;
+
+        if (!first)
+            [self writeByte:','];
+        first = NO;
+
+        [self writeString:property.JSONKey];
+        [self writeByte:':'];
+        [self writeObject:value options:propertyOptions];
+    }
+    [self writeByte:'}'];
+}
+
+-(void)writeArray:(NSArray *)array options:(NSDictionary *)options
+{
+    [self writeByte:'['];
+
+    BOOL first = YES;
+    for (id object in array)
+    {
+        if (!first)
+            [self writeByte:','];
+        first = NO;
+
+        // Drain temporaries per element so a large array doesn't accumulate them
+        @autoreleasepool {
+            [self writeObject:object options:options];
+        }
+    }
+
+    [self writeByte:']'];
+}
+
+-(void)writeDictionary:(NSDictionary *)dictionary options:(NSDictionary *)options
+{
+    [self writeByte:'{'];
+
+    BOOL first = YES;
+    for (NSString *key in dictionary)
+    {
+        NSAssert2([key isKindOfClass:[NSString class]], @"Keys in dictionaries being serialized must be NSString objects. Invalid key: \"%@\" in dictionary: %@", key, dictionary);
+
+        if (!first)
+            [self writeByte:','];
+        first = NO;
+
+        [self writeString:[GRSerialization convertString:key options:options]];
+        [self writeByte:':'];
+        [self writeObject:dictionary[key] options:options];
+    }
+
+    [self writeByte:'}'];
+}
+
+-(void)writeString:(NSString *)string
+{
+    const char *characters = [string UTF8String];
+    NSUInteger length      = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+
+    // Strings that aren't valid Unicode (eg. with a lone surrogate) have no UTF-8 form, so the write fails, as it does with NSJSONSerialization
+    if (!characters)
+    {
+        _failed = YES;
+        return;
+    }
+
+    [self writeByte:'"'];
+
+    // Write runs of characters that don't need escaping in one go
+    NSUInteger runStart = 0;
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        unsigned char character = characters[i];
+        if (character >= 0x20 && character != '"' && character != '\\')
+            continue;
+
+        [self writeBytes:characters + runStart length:i - runStart];
+        runStart = i + 1;
+
+        switch (character)
+        {
+            case '"':  [self writeCString:"\\\""]; break;
+            case '\\': [self writeCString:"\\\\"]; break;
+            case '\n': [self writeCString:"\\n"];  break;
+            case '\r': [self writeCString:"\\r"];  break;
+            case '\t': [self writeCString:"\\t"];  break;
+            case '\b': [self writeCString:"\\b"];  break;
+            case '\f': [self writeCString:"\\f"];  break;
+            default:
+            {
+                char escape[7];
+                snprintf(escape, sizeof(escape), "\\u%04x", character);
+                [self writeBytes:escape length:6];
+            }
+        }
+    }
+    [self writeBytes:characters + runStart length:length - runStart];
+
+    [self writeByte:'"'];
+}
+
+-(void)writeNumber:(NSNumber *)number
+{
+    // BOOLs are boxed as the CFBoolean singletons
+    if (number == (__bridge id)kCFBooleanTrue)
+    {
+        [self writeCString:"true"];
+        return;
+    }
+    else if (number == (__bridge id)kCFBooleanFalse)
+    {
+        [self writeCString:"false"];
+        return;
+    }
+
+    char characters[32];
+    switch ([number objCType][0])
+    {
+        case 'f':
+        case 'd':
+        {
+            double value = [number doubleValue];
+            if (!isfinite(value))
+                [NSException raise:NSInvalidArgumentException format:@"Invalid number value (%@) in JSON write", number];
+
+            // Use the shortest form that reads back as the same value: most values fit in the fewer digits, only some need all of them
+            if ([number objCType][0] == 'f')
+            {
+                snprintf(characters, sizeof(characters), "%.6g", value);
+                if ((float)strtod(characters, NULL) != (float)value)
+                    snprintf(characters, sizeof(characters), "%.9g", value);
+            }
+            else
+            {
+                snprintf(characters, sizeof(characters), "%.15g", value);
+                if (strtod(characters, NULL) != value)
+                    snprintf(characters, sizeof(characters), "%.17g", value);
+            }
+            break;
+        }
+        case 'C':
+        case 'S':
+        case 'I':
+        case 'L':
+        case 'Q':
+            snprintf(characters, sizeof(characters), "%llu", [number unsignedLongLongValue]);
+            break;
+        default:
+            snprintf(characters, sizeof(characters), "%lld", [number longLongValue]);
+    }
+
+    [self writeCString:characters];
+}
+
+-(void)writeArrayWithEncodedElements:(NSArray *)elements
+{
+    [self writeByte:'['];
+
+    BOOL first = YES;
+    for (NSData *element in elements)
+    {
+        if (!first)
+            [self writeByte:','];
+
+        [self writeBytes:[element bytes] length:[element length]];
+        first = NO;
+    }
+
+    [self writeByte:']'];
+}
+
+@end
+
+#pragma mark - JSON reader
+
+@implementation GRJSONReader
+{
+    NSInputStream *_stream;
+    uint8_t *_buffer;
+    NSUInteger _length;
+    NSUInteger _position;
+    NSUInteger _depth;
+    BOOL _endOfStream;
+    BOOL _failed;
+
+    // Reused for decoding strings
+    NSMutableData *_stringBuffer;
+}
+
+-(id)initWithStream:(NSInputStream *)stream
+{
+    if (self = [super init])
+    {
+        _stream       = stream;
+        _buffer       = malloc(GRJSONReaderBufferSize);
+        _stringBuffer = [NSMutableData data];
+    }
+
+    return self;
+}
+
+-(void)dealloc
+{
+    free(_buffer);
+}
+
+#pragma mark Input
+
+/* Returns the next byte without consuming it, or -1 at the end of the stream (or after an error). */
+-(int)peekByte
+{
+    if (_position == _length)
+    {
+        if (_endOfStream || _failed)
+            return -1;
+
+        NSInteger result = [_stream read:_buffer maxLength:GRJSONReaderBufferSize];
+        if (result <= 0)
+        {
+            _failed      = result < 0;
+            _endOfStream = YES;
+            return -1;
+        }
+
+        _length   = result;
+        _position = 0;
+    }
+
+    return _buffer[_position];
+}
+
+/* Returns the next byte that isn't whitespace without consuming it. */
+-(int)peekToken
+{
+    int byte;
+    while ((byte = [self peekByte]) == ' ' || byte == '\n' || byte == '\r' || byte == '\t')
+        _position++;
+
+    return byte;
+}
+
+/* Consumes the next token if it's the given character, fails otherwise. */
+-(BOOL)expectToken:(char)token
+{
+    if ([self peekToken] != token)
+    {
+        _failed = YES;
+        return NO;
+    }
+
+    _position++;
+    return YES;
+}
+
+/* After a value in a container: consumes a separator and returns YES if another value follows, or consumes the closing character and returns NO. */
+-(BOOL)readSeparatorBeforeClosingToken:(char)closingToken
+{
+    int token = [self peekToken];
+    if (token == ',' || token == closingToken)
+        _position++;
+    else
+        _failed = YES;
+
+    return token == ',';
+}
+
+#pragma mark Objects
+
+-(BOOL)enumerateObjectsWithClass:(Class)class options:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block
+{
+    // An empty stream contains no objects
+    int token = [self peekToken];
+    if (token < 0)
+        return !_failed;
+
+    BOOL stop = NO;
+    if (token == '[')
+        [self readObjectsWithClass:class options:options usingBlock:block stop:&stop];
+    else if (token == '{' && [NSStringFromClass(class) isEqualToString:@"GRObject"])
+        [self readPayloadWithOptions:options usingBlock:block stop:&stop];
+    else
+    {
+        @autoreleasepool {
+            id object = [self readObjectWithClass:class options:options];
+            if (!_failed)
+                block(object, &stop);
+        }
+    }
+
+    // Anything but whitespace after the top-level value means the stream isn't the JSON we think it is
+    if (!stop && !_failed && [self peekToken] >= 0)
+        _failed = YES;
+
+    return !_failed;
+}
+
+-(void)readObjectsWithClass:(Class)class options:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block stop:(BOOL *)stop
+{
+    if (![self expectToken:'['])
+        return;
+
+    if ([self peekToken] == ']')
+    {
+        _position++;
+        return;
+    }
+
+    do
+    {
+        // Only one object's temporaries are alive at a time
+        @autoreleasepool {
+            id object = [self readObjectWithClass:class options:options];
+            if (_failed)
+                return;
+
+            block(object, stop);
+        }
+    }
+    while (!*stop && [self readSeparatorBeforeClosingToken:']']);
+}
+
+-(void)readPayloadWithOptions:(NSDictionary *)options usingBlock:(void (^)(id object, BOOL *stop))block stop:(BOOL *)stop
+{
+    if (![self expectToken:'{'])
+        return;
+
+    if ([self peekToken] == '}')
+    {
+        _position++;
+        return;
+    }
+
+    do
+    {
+        // Infer the class of the objects from the key
+        NSString *key = [self readString];
+        if (!key || ![self expectToken:':'])
+            return;
+
+        Class class = [GRSerialization objectSubclassWithKey:[GRSerialization convertString:key options:options] options:options];
+
+        if ([self peekToken] == '[')
+            [self readObjectsWithClass:class options:options usingBlock:block stop:stop];
+        else
+        {
+            @autoreleasepool {
+                id object = [self readObjectWithClass:class options:options];
+                if (!_failed)
+                    block(object, stop);
+            }
+        }
+    }
+    while (!_failed && !*stop && [self readSeparatorBeforeClosingToken:'}']);
+}
+
+-(id)readObjectWithClass:(Class)class options:(NSDictionary *)options
+{
+    NSMutableDictionary *objectOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+    if (class)
+        objectOptions[GRSerializationOptionDestinationClassKey] = class;
+
+    // Anything that isn't a JSON object of a serializable class is read as a whole and converted like +objectWithJSON:class:options: would
+    if (!class || [self peekToken] != '{' || ![class conformsToProtocol:@protocol(GRSerializable)])
+    {
+        id value = [self readValue];
+        return _failed ? nil : [GRSerialization objectWithObject:value options:objectOptions];
+    }
+
+    GRSerializationPlan *plan = [GRSerialization planForClass:class options:options];
+
+    // Map each key to a property as we read it, skipping keys the class doesn't have and converting the values
+    NSMutableDictionary *dictionaryRepresentation = [NSMutableDictionary dictionary];
+    _position++;
+    if ([self peekToken] == '}')
+        _position++;
+    else
+    {
+        do
+        {
+            NSString *key = [self readString];
+            if (!key || ![self expectToken:':'])
+                return nil;
+
+            id value = [self readValue];
+            if (_failed)
+                return nil;
+
+            GRSerializationPlanProperty *property = [plan propertyForKey:[GRSerialization convertString:key options:options]];
+            if (!property || value == [NSNull null])
+                continue;
+
+            id newValue = property.objectConverter(value, property, objectOptions);
+            if (newValue)
+                dictionaryRepresentation[property.name] = newValue;
+        }
+        while ([self readSeparatorBeforeClosingToken:'}']);
+    }
+
+    if (_failed)
+        return nil;
+
+    return [[class alloc] initWithDictionaryRepresentation:dictionaryRepresentation context:options[GRSerializationOptionContextKey]];
+}
+
+#pragma mark Values
+
+-(id)readValue
+{
+    switch ([self peekToken])
+    {
+        case '{': return [self readDictionary];
+        case '[': return [self readArray];
+        case '"': return [self readString];
+        case 't': return [self readLiteral:"true" value:@(YES)];
+        case 'f': return [self readLiteral:"false" value:@(NO)];
+        case 'n': return [self readLiteral:"null" value:[NSNull null]];
+        case '-': case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return [self readNumber];
+    }
+
+    _failed = YES;
+    return nil;
+}
+
+-(NSDictionary *)readDictionary
+{
+    if (++_depth > GRJSONReaderMaximumDepth || ![self expectToken:'{'])
+    {
+        _failed = YES;
+        return nil;
+    }
+
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionary];
+    if ([self peekToken] == '}')
+        _position++;
+    else
+    {
+        do
+        {
+            NSString *key = [self readString];
+            if (!key || ![self expectToken:':'])
+                return nil;
+
+            id value = [self readValue];
+            if (_failed)
+                return nil;
+
+            dictionary[key] = value;
+        }
+        while ([self readSeparatorBeforeClosingToken:'}']);
+    }
+
+    _depth--;
+    return [dictionary copy];
+}
+
+-(NSArray *)readArray
+{
+    if (++_depth > GRJSONReaderMaximumDepth || ![self expectToken:'['])
+    {
+        _failed = YES;
+        return nil;
+    }
+
+    NSMutableArray *array = [NSMutableArray array];
+    if ([self peekToken] == ']')
+        _position++;
+    else
+    {
+        do
+        {
+            id value = [self readValue];
+            if (_failed)
+                return nil;
+
+            [array addObject:value];
+        }
+        while ([self readSeparatorBeforeClosingToken:']']);
+    }
+
+    _depth--;
+    return [array copy];
+}
+
+-(NSString *)readString
+{
+    if (![self expectToken:'"'])
+        return nil;
+
+    [_stringBuffer setLength:0];
+    while (YES)
+    {
+        if ([self peekByte] < 0)
+        {
+            _failed = YES;
+            return nil;
+        }
+
+        // Copy the run of plain characters left in the buffer in one go
+        NSUInteger runStart = _position;
+        while (_position < _length && _buffer[_position] != '"' && _buffer[_position] != '\\' && _buffer[_position] >= 0x20)
+            _position++;
+        [_stringBuffer appendBytes:_buffer + runStart length:_position - runStart];
+
+        if (_position == _length)
+            continue;
+
+        uint8_t byte = _buffer[_position++];
+        if (byte == '"')
+            break;
+        else if (byte != '\\' || ![self readEscape])
+        {
+            _failed = YES;
+            return nil;
+        }
+    }
+
+    NSString *string = [[NSString alloc] initWithBytes:[_stringBuffer bytes] length:[_stringBuffer length] encoding:NSUTF8StringEncoding];
+    if (!string)
+        _failed = YES;
+
+    return string;
+}
+
+-(BOOL)readEscape
+{
+    int byte = [self peekByte];
+    if (byte < 0)
+        return NO;
+    _position++;
+
+    char character;
+    switch (byte)
+    {
+        case '"':  character = '"';  break;
+        case '\\': character = '\\'; break;
+        case '/':  character = '/';  break;
+        case 'b':  character = '\b'; break;
+        case 'f':  character = '\f'; break;
+        case 'n':  character = '\n'; break;
+        case 'r':  character = '\r'; break;
+        case 't':  character = '\t'; break;
+        case 'u':  return [self readUnicodeEscape];
+        default:   return NO;
+    }
+
+    [_stringBuffer appendBytes:&character length:1];
+    return YES;
+}
+
+-(BOOL)readUnicodeEscape
+{
+    // Read the code unit, and the low surrogate that follows a high surrogate
+    int codeUnit = [self readHexCodeUnit];
+    if (codeUnit < 0)
+        return NO;
+
+    uint32_t codePoint = codeUnit;
+    if (codeUnit >= 0xD800 && codeUnit <= 0xDBFF)
+    {
+        if ([self peekByte] != '\\')
+            return NO;
+        _position++;
+        if ([self peekByte] != 'u')
+            return NO;
+        _position++;
+
+        int lowSurrogate = [self readHexCodeUnit];
+        if (lowSurrogate < 0xDC00 || lowSurrogate > 0xDFFF)
+            return NO;
+
+        codePoint = 0x10000 + ((codeUnit - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+    }
+
+    // Append it as UTF-8
+    uint8_t bytes[4];
+    NSUInteger length;
+    if (codePoint < 0x80)
+    {
+        bytes[0] = codePoint;
+        length = 1;
+    }
+    else if (codePoint < 0x800)
+    {
+        bytes[0] = 0xC0 | (codePoint >> 6);
+        bytes[1] = 0x80 | (codePoint & 0x3F);
+        length = 2;
+    }
+    else if (codePoint < 0x10000)
+    {
+        bytes[0] = 0xE0 | (codePoint >> 12);
+        bytes[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+        bytes[2] = 0x80 | (codePoint & 0x3F);
+        length = 3;
+    }
+    else
+    {
+        bytes[0] = 0xF0 | (codePoint >> 18);
+        bytes[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+        bytes[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+        bytes[3] = 0x80 | (codePoint & 0x3F);
+        length = 4;
+    }
+
+    [_stringBuffer appendBytes:bytes length:length];
+    return YES;
+}
+
+/* Reads 4 hex digits, returning -1 if they aren't valid. */
+-(int)readHexCodeUnit
+{
+    int codeUnit = 0;
+    for (NSUInteger i = 0; i < 4; i++)
+    {
+        int byte = [self peekByte];
+        if (byte >= '0' && byte <= '9')
+            codeUnit = codeUnit * 16 + (byte - '0');
+        else if (byte >= 'a' && byte <= 'f')
+            codeUnit = codeUnit * 16 + (byte - 'a' + 10);
+        else if (byte >= 'A' && byte <= 'F')
+            codeUnit = codeUnit * 16 + (byte - 'A' + 10);
+        else
+            return -1;
+
+        _position++;
+    }
+
+    return codeUnit;
+}
+
+-(NSNumber *)readNumber
+{
+    char characters[64];
+    NSUInteger length = 0;
+    BOOL floatingPoint = NO;
+
+    int byte;
+    while ((byte = [self peekByte]) >= 0 &&
+           ((byte >= '0' && byte <= '9') || byte == '-' || byte == '+' || byte == '.' || byte == 'e' || byte == 'E'))
+    {
+        if (length == sizeof(characters) - 1)
+        {
+            _failed = YES;
+            return nil;
+        }
+
+        floatingPoint |= (byte == '.' || byte == 'e' || byte == 'E');
+        characters[length++] = byte;
+        _position++;
+    }
+    characters[length] = '\0';
+
+    // Integers are boxed as integers, unless they're too big to fit
+    char *end;
+    if (!floatingPoint)
+    {
+        errno = 0;
+        long long integerValue = strtoll(characters, &end, 10);
+        if (!errno && !*end)
+            return @(integerValue);
+
+        errno = 0;
+        unsigned long long unsignedValue = strtoull(characters, &end, 10);
+        if (characters[0] != '-' && !errno && !*end)
+            return @(unsignedValue);
+    }
+
+    double value = strtod(characters, &end);
+    if (*end || end == characters)
+    {
+        _failed = YES;
+        return nil;
+    }
+
+    return @(value);
+}
+
+-(id)readLiteral:(const char *)literal value:(id)value
+{
+    for (const char *character = literal; *character; character++)
+    {
+        if ([self peekByte] != *character)
+        {
+            _failed = YES;
+            return nil;
+        }
+
+        _position++;
+    }
+
+    return value;
+}
+
+@end
+
+#pragma mark - Binary format
+
+/* The binary format stores the objects of one class as a header followed by length-prefixed records:
+
+    header: "GRB" and a version byte, the number of properties (uint32), the name of each property (string)
+    record: the length of the record (uint32), then the value of each property in header order
+
+ Each value is a tag byte followed by the value itself. Numbers are little endian and strings are UTF-8 prefixed with their length in bytes (uint32). Properties are looked up by name when reading, so a store can be read after properties have been added to or removed from the class. */
+enum GRBinaryTag {
+    GRBinaryTagNull = 0,
+    GRBinaryTagFalse,
+    GRBinaryTagTrue,
+    GRBinaryTagInteger,         // int64
+    GRBinaryTagUnsignedInteger, // uint64, for values too big for an int64
+    GRBinaryTagDouble,          // float64
+    GRBinaryTagString,          // string
+    GRBinaryTagData,            // uint32 length, then bytes
+    GRBinaryTagDate,            // float64 seconds since 1970
+    GRBinaryTagArray,           // uint32 count, then values
+    GRBinaryTagDictionary       // uint32 count, then a string key and a value for each
+};
+
+static void GRBinaryAppendUInt32(NSMutableData *data, uint32_t value)
+{
+    value = CFSwapInt32HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void GRBinaryAppendUInt64(NSMutableData *data, uint64_t value)
+{
+    value = CFSwapInt64HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void GRBinaryAppendDouble(NSMutableData *data, double value)
+{
+    CFSwappedFloat64 swappedValue = CFConvertDoubleHostToSwapped(value);
+    [data appendBytes:&swappedValue length:sizeof(swappedValue)];
+}
+
+static void GRBinaryAppendTag(NSMutableData *data, uint8_t tag)
+{
+    [data appendBytes:&tag length:1];
+}
+
+static void GRBinaryAppendString(NSMutableData *data, NSString *string)
+{
+    // Encode the string straight into the data
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    GRBinaryAppendUInt32(data, (uint32_t)length);
+
+    NSUInteger offset = [data length];
+    [data increaseLengthBy:length];
+    [string getBytes:(uint8_t *)[data mutableBytes] + offset maxLength:length usedLength:NULL encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [string length]) remainingRange:NULL];
+}
+
+static void GRBinaryAppendValue(NSMutableData *data, id value)
+{
+    if (!value || value == [NSNull null])
+        GRBinaryAppendTag(data, GRBinaryTagNull);
+    else if ([value isKindOfClass:[NSString class]])
+    {
+        GRBinaryAppendTag(data, GRBinaryTagString);
+        GRBinaryAppendString(data, value);
+    }
+    else if ([value isKindOfClass:[NSNumber class]])
+    {
+        char type = [value objCType][0];
+        if (value == (__bridge id)kCFBooleanTrue || value == (__bridge id)kCFBooleanFalse)
+            GRBinaryAppendTag(data, value == (__bridge id)kCFBooleanTrue ? GRBinaryTagTrue : GRBinaryTagFalse);
+        else if (type == 'f' || type == 'd')
+        {
+            GRBinaryAppendTag(data, GRBinaryTagDouble);
+            GRBinaryAppendDouble(data, [value doubleValue]);
+        }
+        else if ((type == 'Q' || type == 'L') && [value unsignedLongLongValue] > LLONG_MAX)
+        {
+            GRBinaryAppendTag(data, GRBinaryTagUnsignedInteger);
+            GRBinaryAppendUInt64(data, [value unsignedLongLongValue]);
+        }
+        else
+        {
+            GRBinaryAppendTag(data, GRBinaryTagInteger);
+            GRBinaryAppendUInt64(data, (uint64_t)[value longLongValue]);
+        }
+    }
+    else if ([value isKindOfClass:[NSDate class]])
+    {
+        GRBinaryAppendTag(data, GRBinaryTagDate);
+        GRBinaryAppendDouble(data, [value timeIntervalSince1970]);
+    }
+    else if ([value isKindOfClass:[NSData class]])
+    {
+        GRBinaryAppendTag(data, GRBinaryTagData);
+        GRBinaryAppendUInt32(data, (uint32_t)[value length]);
+        [data appendData:value];
+    }
+    else if ([value isKindOfClass:[NSArray class]])
+    {
+        GRBinaryAppendTag(data, GRBinaryTagArray);
+        GRBinaryAppendUInt32(data, (uint32_t)[value count]);
+        for (id subvalue in value)
+            GRBinaryAppendValue(data, subvalue);
+    }
+    else if ([value isKindOfClass:[NSDictionary class]])
+    {
+        GRBinaryAppendTag(data, GRBinaryTagDictionary);
+        GRBinaryAppendUInt32(data, (uint32_t)[value count]);
+        for (NSString *key in value)
+        {
+            NSCAssert2([key isKindOfClass:[NSString class]], @"Keys in dictionaries being serialized must be NSString objects. Invalid key: \"%@\" in dictionary: %@", key, value);
+            GRBinaryAppendString(data, key);
+            GRBinaryAppendValue(data, value[key]);
+        }
+    }
+    else
+        [NSException raise:NSInvalidArgumentException format:@"Invalid type in binary write (%@)", NSStringFromClass([value class])];
+}
+
+static BOOL GRBinaryReadUInt32(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, uint32_t *value)
+{
+    if (length - *offset < sizeof(uint32_t))
+        return NO;
+
+    memcpy(value, bytes + *offset, sizeof(uint32_t));
+    *value = CFSwapInt32LittleToHost(*value);
+    *offset += sizeof(uint32_t);
+    return YES;
+}
+
+static BOOL GRBinaryReadUInt64(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, uint64_t *value)
+{
+    if (length - *offset < sizeof(uint64_t))
+        return NO;
+
+    memcpy(value, bytes + *offset, sizeof(uint64_t));
+    *value = CFSwapInt64LittleToHost(*value);
+    *offset += sizeof(uint64_t);
+    return YES;
+}
+
+static BOOL GRBinaryReadDouble(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, double *value)
+{
+    CFSwappedFloat64 swappedValue;
+    if (length - *offset < sizeof(swappedValue))
+        return NO;
+
+    memcpy(&swappedValue, bytes + *offset, sizeof(swappedValue));
+    *value = CFConvertDoubleSwappedToHost(swappedValue);
+    *offset += sizeof(swappedValue);
+    return YES;
+}
+
+static NSString * GRBinaryReadString(const uint8_t *bytes, NSUInteger length, NSUInteger *offset)
+{
+    uint32_t stringLength;
+    if (!GRBinaryReadUInt32(bytes, length, offset, &stringLength) || length - *offset < stringLength)
+        return nil;
+
+    NSString *string = [[NSString alloc] initWithBytes:bytes + *offset length:stringLength encoding:NSUTF8StringEncoding];
+    *offset += stringLength;
+    return string;
+}
+
+/* Reads the value at `offset` and moves `offset` past it. Returns NSNull for null values and nil if the bytes are malformed. */
+static id GRBinaryReadValue(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, NSUInteger depth)
+{
+    if (*offset >= length || depth > GRBinaryMaximumDepth)
+        return nil;
+
+    uint8_t tag = bytes[(*offset)++];
+    switch (tag)
+    {
+        case GRBinaryTagNull:
+            return [NSNull null];
+
+        case GRBinaryTagFalse:
+            return @(NO);
+
+        case GRBinaryTagTrue:
+            return @(YES);
+
+        case GRBinaryTagInteger:
+        case GRBinaryTagUnsignedInteger:
+        {
+            uint64_t value;
+            if (!GRBinaryReadUInt64(bytes, length, offset, &value))
+                return nil;
+
+            return tag == GRBinaryTagInteger ? @((long long)value) : @(value);
+        }
+
+        case GRBinaryTagDouble:
+        case GRBinaryTagDate:
+        {
+            double value;
+            if (!GRBinaryReadDouble(bytes, length, offset, &value))
+                return nil;
+
+            return tag == GRBinaryTagDouble ? @(value) : [NSDate dateWithTimeIntervalSince1970:value];
+        }
+
+        case GRBinaryTagString:
+            return GRBinaryReadString(bytes, length, offset);
+
+        case GRBinaryTagData:
+        {
+            uint32_t dataLength;
+            if (!GRBinaryReadUInt32(bytes, length, offset, &dataLength) || length - *offset < dataLength)
+                return nil;
+
+            NSData *data = [NSData dataWithBytes:bytes + *offset length:dataLength];
+            *offset += dataLength;
+            return data;
+        }
+
+        case GRBinaryTagArray:
+        {
+            uint32_t count;
+            if (!GRBinaryReadUInt32(bytes, length, offset, &count))
+                return nil;
+
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:MIN(count, length - *offset)];
+            for (uint32_t i = 0; i < count; i++)
+            {
+                id value = GRBinaryReadValue(bytes, length, offset, depth + 1);
+                if (!value)
+                    return nil;
+
+                [array addObject:value];
+            }
+
+            return [array copy];
+        }
+
+        case GRBinaryTagDictionary:
+        {
+            uint32_t count;
+            if (!GRBinaryReadUInt32(bytes, length, offset, &count))
+                return nil;
+
+            NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:MIN(count, length - *offset)];
+            for (uint32_t i = 0; i < count; i++)
+            {
+                NSString *key = GRBinaryReadString(bytes, length, offset);
+                id value      = key ? GRBinaryReadValue(bytes, length, offset, depth + 1) : nil;
+                if (!value)
+                    return nil;
+
+                dictionary[key] = value;
+            }
+
+            return [dictionary copy];
+        }
+    }
+
+    return nil;
+}
+
+/* Moves `offset` past the value at `offset` without decoding it. Returns NO if the bytes are malformed. */
+static BOOL GRBinarySkipValue(const uint8_t *bytes, NSUInteger length, NSUInteger *offset, NSUInteger depth)
+{
+    if (*offset >= length || depth > GRBinaryMaximumDepth)
+        return NO;
+
+    NSUInteger size = 0;
+    uint32_t count;
+    switch (bytes[(*offset)++])
+    {
+        case GRBinaryTagNull:
+        case GRBinaryTagFalse:
+        case GRBinaryTagTrue:
+            return YES;
+
+        case GRBinaryTagInteger:
+        case GRBinaryTagUnsignedInteger:
+        case GRBinaryTagDouble:
+        case GRBinaryTagDate:
+            size = sizeof(uint64_t);
+            break;
+
+        case GRBinaryTagString:
+        case GRBinaryTagData:
+            if (!GRBinaryReadUInt32(bytes, length, offset, &count))
+                return NO;
+            size = count;
+            break;
+
+        case GRBinaryTagArray:
+        case GRBinaryTagDictionary:
+        {
+            BOOL dictionary = bytes[*offset - 1] == GRBinaryTagDictionary;
+            if (!GRBinaryReadUInt32(bytes, length, offset, &count))
+                return NO;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                // Dictionary keys are bare strings
+                uint32_t keyLength;
+                if (dictionary && (!GRBinaryReadUInt32(bytes, length, offset, &keyLength) || length - *offset < keyLength))
+                    return NO;
+                if (dictionary)
+                    *offset += keyLength;
+
+                if (!GRBinarySkipValue(bytes, length, offset, depth + 1))
+                    return NO;
+            }
+            return YES;
+        }
+
+        default:
+            return NO;
+    }
+
+    if (length - *offset < size)
+        return NO;
+
+    *offset += size;
+    return YES;
+}
+
+static BOOL GRBinaryWriteToStream(NSOutputStream *stream, const uint8_t *bytes, NSUInteger length)
+{
+    NSUInteger written = 0;
+    while (written < length)
+    {
+        NSInteger result = [stream write:bytes + written maxLength:length - written];
+        if (result <= 0)
+            return NO;
+
+        written += result;
+    }
+
+    return YES;
+}
+
+#pragma mark - Binary reader
+
+@implementation GRBinaryReader
+{
+    NSInputStream *_stream;
+    uint8_t *_buffer;
+    NSUInteger _length;
+    NSUInteger _position;
+    BOOL _endOfStream;
+
+    // Reused for each record
+    NSMutableData *_record;
+}
+
+-(id)initWithStream:(NSInputStream *)stream
+{
+    if (self = [super init])
+    {
+        _stream = stream;
+        _buffer = malloc(GRBinaryBufferSize);
+        _record = [NSMutableData data];
+    }
+
+    return self;
+}
+
+-(void)dealloc
+{
+    free(_buffer);
+}
+
+-(NSUInteger)readBytes:(void *)bytes length:(NSUInteger)length
+{
+    NSUInteger read = 0;
+    while (read < length)
+    {
+        // Refill the buffer when it's empty
+        if (_position == _length)
+        {
+            if (_endOfStream)
+                break;
+
+            NSInteger result = [_stream read:_buffer maxLength:GRBinaryBufferSize];
+            if (result <= 0)
+            {
+                _failed      = result < 0;
+                _endOfStream = YES;
+                break;
+            }
+
+            _length   = result;
+            _position = 0;
+        }
+
+        NSUInteger available = MIN(length - read, _length - _position);
+        memcpy((uint8_t *)bytes + read, _buffer + _position, available);
+        _position += available;
+        read      += available;
+    }
+
+    return read;
+}
+
+-(BOOL)readUInt32:(uint32_t *)value
+{
+    if ([self readBytes:value length:sizeof(uint32_t)] != sizeof(uint32_t))
+    {
+        _failed = YES;
+        return NO;
+    }
+
+    *value = CFSwapInt32LittleToHost(*value);
+    return YES;
+}
+
+-(NSString *)readString
+{
+    uint32_t length;
+    if (![self readUInt32:&length])
+        return nil;
+
+    [_record setLength:length];
+    if ([self readBytes:[_record mutableBytes] length:length] != length)
+    {
+        _failed = YES;
+        return nil;
+    }
+
+    return [[NSString alloc] initWithData:_record encoding:NSUTF8StringEncoding];
+}
+
+-(NSData *)readRecord
+{
+    // The end of the stream is only valid between records
+    uint32_t length;
+    NSUInteger lengthLength = [self readBytes:&length length:sizeof(length)];
+    if (!lengthLength)
+        return nil;
+    if (lengthLength != sizeof(length))
+    {
+        _failed = YES;
+        return nil;
+    }
+
+    length = CFSwapInt32LittleToHost(length);
+    [_record setLength:length];
+    if ([self readBytes:[_record mutableBytes] length:length] != length)
+    {
+        _failed = YES;
+        return nil;
+    }
+
+    return _record;
+}
+
+@end
+
+#pragma mark - Binary store
+
+@implementation GRBinaryStore
+{
+    NSData *_data;
+    Class _managedClass;
+    NSDictionary *_objectOptions;
+
+    // The plan property for each property in the header (NSNull for properties the class no longer has)
+    NSArray *_schema;
+
+    // Where each record's values start, and how long they are
+    NSUInteger *_recordOffsets;
+    NSUInteger *_recordLengths;
+}
+
+-(instancetype)initWithData:(NSData *)data class:(Class)class options:(NSDictionary *)options
+{
+    if (self = [super init])
+    {
+        _data         = data;
+        _managedClass = class;
+
+        NSMutableDictionary *objectOptions = [NSMutableDictionary dictionaryWithDictionary:options];
+        objectOptions[GRSerializationOptionDestinationClassKey] = class;
+        _objectOptions = [objectOptions copy];
+
+        const uint8_t *bytes = [data bytes];
+        NSUInteger length    = [data length];
+        NSUInteger offset    = sizeof(GRBinaryMagic);
+        if (length < offset || memcmp(bytes, GRBinaryMagic, sizeof(GRBinaryMagic)))
+            return nil;
+
+        // Read the header
+        uint32_t propertyCount;
+        if (!GRBinaryReadUInt32(bytes, length, &offset, &propertyCount))
+            return nil;
+
+        GRSerializationPlan *plan      = [GRSerialization planForClass:class options:options];
+        NSMutableArray *propertyNames  = [NSMutableArray arrayWithCapacity:propertyCount];
+        NSMutableArray *schema         = [NSMutableArray arrayWithCapacity:propertyCount];
+        for (uint32_t i = 0; i < propertyCount; i++)
+        {
+            NSString *name = GRBinaryReadString(bytes, length, &offset);
+            if (!name)
+                return nil;
+
+            [propertyNames addObject:name];
+            [schema addObject:(id)[plan propertyForKey:name] ?: [NSNull null]];
+        }
+        _propertyNames = [propertyNames copy];
+        _schema        = [schema copy];
+        _matchesClass  = [_propertyNames isEqualToArray:[plan.properties valueForKey:@"name"]];
+
+        // Find the records, without looking inside them
+        NSUInteger capacity = 64;
+        _recordOffsets = malloc(sizeof(NSUInteger) * capacity);
+        _recordLengths = malloc(sizeof(NSUInteger) * capacity);
+        while (offset < length)
+        {
+            uint32_t recordLength;
+            if (!GRBinaryReadUInt32(bytes, length, &offset, &recordLength) || length - offset < recordLength)
+                return nil;
+
+            if (_count == capacity)
+            {
+                capacity *= 2;
+                _recordOffsets = realloc(_recordOffsets, sizeof(NSUInteger) * capacity);
+                _recordLengths = realloc(_recordLengths, sizeof(NSUInteger) * capacity);
+            }
+
+            _recordOffsets[_count] = offset;
+            _recordLengths[_count] = recordLength;
+            _count++;
+            offset += recordLength;
+        }
+    }
+
+    return self;
+}
+
+-(void)dealloc
+{
+    free(_recordOffsets);
+    free(_recordLengths);
+}
+
+-(id)valueForProperty:(NSString *)property ofRecordAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _count);
+
+    NSUInteger position = [self.propertyNames indexOfObject:property];
+    if (position == NSNotFound)
+        return nil;
+
+    // Skip the values before the property's
+    const uint8_t *bytes = (const uint8_t *)[_data bytes] + _recordOffsets[index];
+    NSUInteger length    = _recordLengths[index];
+    NSUInteger offset    = 0;
+    for (NSUInteger i = 0; i < position; i++)
+        if (!GRBinarySkipValue(bytes, length, &offset, 0))
+            return nil;
+
+    id value = GRBinaryReadValue(bytes, length, &offset, 0);
+
+    return value == [NSNull null] ? nil : value;
+}
+
+-(id)objectValueForProperty:(NSString *)property ofRecordAtIndex:(NSUInteger)index
+{
+    // Properties the store doesn't have have no value
+    NSUInteger position = [self.propertyNames indexOfObject:property];
+    if (position == NSNotFound)
+        return nil;
+
+    id value = [self valueForProperty:property ofRecordAtIndex:index];
+    GRSerializationPlanProperty *planProperty = _schema[position];
+    if (!value || planProperty == (id)[NSNull null])
+        return nil;
+
+    return planProperty.objectConverter(value, planProperty, _objectOptions);
+}
+
+-(id)objectAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _count);
+
+    return [GRSerialization objectWithBinaryRecord:(const uint8_t *)[_data bytes] + _recordOffsets[index] length:_recordLengths[index] schema:_schema class:_managedClass options:_objectOptions];
+}
+
+-(NSData *)recordAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _count);
+
+    return [NSData dataWithBytesNoCopy:(uint8_t *)[_data bytes] + _recordOffsets[index] length:_recordLengths[index] freeWhenDone:NO];
+}
+
+@end
@@ -12,9 +12,10 @@
 /* GRSource is the model-controller layer of your application that manages your application's objects. Each subclass of GRObject has a single source, and a source can only correspond to one GRObject subclass. Each source has an objects array that contains all the objects of its managed class, and can notify observers when any of these objects changes, is added or removed. */
 
 @protocol GRSourceObserver;
+@class GRSourceChangeSet;
 @interface GRSource : NSObject <GRObjectRegistrar>
 
-/* Returns the source corresponding to the given class. You should always access a source with this method. */
+/* Returns the source corresponding to the given class. You should always access a source with this method. It's safe to call from any thread, and looking up a source that already exists doesn't wait on other threads. */
 +(instancetype)source:(Class)managedClass;
 
 /* The designated initializer for GRSource. You should never call this in your own code, but you may override it in a subclass and call `[super initWithManagedClass:]` to customize your source when it's created. */
@@ -23,8 +24,68 @@
 /* The class managed by the source. A source can only have one class, and every class has its own source. */
 @property (strong, nonatomic, readonly) Class managedClass;
 
-/* All objects of the managed class that are registered with the source. */
-@property (strong, nonatomic) NSMutableArray *objects;
+/* All objects of the managed class that are registered with the source, in the order they were registered. Each call returns a new array, so you can save and remove objects while you iterate it. Use GRObject's `-save` and `-remove` (or the registration methods) to change the source's objects. */
+@property (strong, nonatomic, readonly) NSArray *objects;
+
+/* Registers every object in the array at once. Observers are notified with a single batched message rather than once per object, which makes adding large numbers of objects much cheaper.
+ @param objects The objects to register
+ */
+-(void)registerObjects:(NSArray *)objects;
+
+/* Deregisters every object in the array at once. Observers are notified with a single batched message rather than once per object, which makes removing large numbers of objects much cheaper.
+ @param objects The objects to deregister
+ */
+-(void)deregisterObjects:(NSArray *)objects;
+
+/* Runs the block with observer notifications suspended. Objects registered, updated and deregistered inside the block are coalesced (an object inserted and then updated is just an insert, an object inserted and then removed is never mentioned), and observers receive one batched message per type of change when the block returns. Batches can be nested, in which case observers are notified when the outermost one ends.
+
+    [[MYRecipe source] performBatchUpdates:^{
+        for (NSDictionary *info in downloadedRecipes)
+            [[[MYRecipe alloc] initWithInfo:info] save];
+    }];
+
+ @param updates The block that changes the source's objects
+ */
+-(void)performBatchUpdates:(void (^)(void))updates;
+
+/* Returns the registered object whose `uniqueIdentifier` matches the given identifier, or nil if there is none. This is a dictionary lookup, so it's cheap to call as often as you like. */
+-(GRObject *)objectWithUniqueIdentifier:(NSString *)uniqueIdentifier;
+
+/* Returns the registered objects whose `property` equals the given value. If `property` is one of the managed class' `+indexedProperties` this is a dictionary lookup, otherwise it scans the objects. For relationship properties you can pass either the related object or its uniqueIdentifier. */
+-(NSArray *)objectsWithValue:(id)value forProperty:(NSString *)property;
+
+/* Returns the registered objects that match the given predicate (all objects if nil). If the predicate is an equality test on an indexed property, or an AND predicate containing one, only the objects in the matching index bucket are evaluated. */
+-(NSArray *)objectsMatchingPredicate:(NSPredicate *)predicate;
+
+/* Immediately applies the changes of objects that coalesce their changes (see GRObject's `+coalescesChanges`) and sends pending changes to observers that implement source:didChangeObjects:, rather than waiting for the end of the run loop turn. Call this when you need those objects and observers (eg. collections) to be up to date right now. */
+-(void)flushChanges;
+
+/* Faults let a source (usually a subclass) register objects without creating them, for example to load objects lazily from disk. A fault is just the uniqueIdentifier of an object: the source asks `-objectForFaultWithUniqueIdentifier:` for the object the first time it's needed, and registers it without notifying observers (as far as they're concerned, it was always there). `-objectWithUniqueIdentifier:` only fires the fault it's asked for. `-objectsWithValue:forProperty:` on an indexed property (and predicates it can answer) fires only the faults `-faultUniqueIdentifiersWithValue:forProperty:` returns, whereas `objects` and the other queries need every object and fire all the remaining faults.
+
+ Objects are added to the end of `objects` as their faults fire (all remaining faults fire in the order they were registered).
+
+ @param uniqueIdentifiers The uniqueIdentifiers of the objects
+ */
+-(void)registerFaultsWithUniqueIdentifiers:(NSArray *)uniqueIdentifiers;
+
+/* Creates the object for a fault. Returns nil by default; subclasses that register faults must override this. */
+-(GRObject *)objectForFaultWithUniqueIdentifier:(NSString *)uniqueIdentifier;
+
+/* Returns the uniqueIdentifiers of the faults whose objects may have the given value for an indexed property, so an index lookup only fires those. Returns every fault by default; subclasses that can read a property without creating the object should override this.
+
+ @param value The value being looked up. Related objects may be given as themselves or by their uniqueIdentifier.
+ @param property The name of an indexed property
+ */
+-(NSArray *)faultUniqueIdentifiersWithValue:(id)value forProperty:(NSString *)property;
+
+/* The uniqueIdentifiers of the faults that haven't fired yet. */
+@property (strong, nonatomic, readonly) NSArray *faultUniqueIdentifiers;
+
+/* The registered objects that have been created, ie. `objects` without firing any faults. */
+-(NSArray *)objectsWithoutFiringFaults;
+
+/* Whether the object is registered with the source. This is a set lookup, and doesn't fire any faults (an object whose fault hasn't fired isn't registered yet). */
+-(BOOL)containsObject:(GRObject *)object;
 
 /* Registers an observer with the source. The source will receive source:didUpdateObject:changeType:keyPath: when any object is added, updated or removed. */
 -(void)registerObserver:(id<GRSourceObserver>)observer;
@@ -45,4 +106,39 @@
  */
 -(void)source:(GRSource *)source didUpdateObject:(GRObject *)object changeType:(GRObjectChangeType)changeType keyPath:(NSString *)keyPath;
 
+@optional
+
+/* Observers that implement this method receive changes as change sets instead of source:didUpdateObject:changeType:keyPath: and source:didUpdateObjects:changeType:. Changes are collected and delivered once per run loop turn, when a performBatchUpdates: block ends, or when `-flushChanges` is called, so setting five properties on an object results in one message rather than five.
+ @param source The source that changed
+ @param changeSet The objects that were inserted, updated and deleted since the last change set
+ */
+-(void)source:(GRSource *)source didChangeObjects:(GRSourceChangeSet *)changeSet;
+
+/* Sent instead of source:didUpdateObject:changeType:keyPath: when many objects change the same way at once, for example through `-deregisterObjects:`. If an observer doesn't implement this method, it receives source:didUpdateObject:changeType:keyPath: for each object instead.
+ @param source The source that changed
+ @param objects The affected objects
+ @param changeType The change that occured to the objects
+ */
+-(void)source:(GRSource *)source didUpdateObjects:(NSArray *)objects changeType:(GRObjectChangeType)changeType;
+
+@end
+
+/* GRSourceChangeSet describes the net changes to a source's objects over a period of time. Changes are coalesced, so each object appears at most once: an object that was inserted and then updated is only in insertedObjects, an object that was inserted and then deleted doesn't appear at all. */
+@interface GRSourceChangeSet : NSObject
+
+/* The objects that were registered with the source. */
+@property (strong, nonatomic, readonly) NSArray *insertedObjects;
+
+/* The objects that changed one or more properties. */
+@property (strong, nonatomic, readonly) NSArray *updatedObjects;
+
+/* The objects that were deregistered from the source. */
+@property (strong, nonatomic, readonly) NSArray *deletedObjects;
+
+/* The total number of inserted, updated and deleted objects. */
+@property (nonatomic, readonly) NSUInteger count;
+
+/* Returns the names of the properties that changed on one of the updatedObjects. */
+-(NSSet *)changedKeyPathsForObject:(GRObject *)object;
+
 @end
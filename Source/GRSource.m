@@ -8,35 +8,140 @@
 
 #import "GRSource.h"
 
-/* The static variable that holds all our application's sources. Subclasses will access this same variable. */
-static NSMutableArray *sources = nil;
+/* The static variable that holds all our application's sources, keyed by their managed class. Subclasses will access this same variable. It's only read and written on `sourcesQueue`: lookups run concurrently, and registering a source is a barrier. */
+static NSMutableDictionary *sources = nil;
+static dispatch_queue_t sourcesQueue = NULL;
+
+/* GRPropertyIndex is a hash index of a source's objects on one property, declared by the managed class in +indexedProperties. Objects are bucketed by the value of the property, or by its uniqueIdentifier if the value is itself a GRObject, so both `author == %@` and `author.uniqueIdentifier == %@` can be answered from the same index. */
+@interface GRPropertyIndex : NSObject
+
+/* `order` is the source's registered objects, which the buckets follow. */
+-(id)initWithProperty:(NSString *)property order:(NSOrderedSet *)order;
+
+@property (strong, nonatomic, readonly) NSString *property;
+
+-(void)addObject:(GRObject *)object;
+-(void)updateObject:(GRObject *)object;
+-(void)removeObject:(GRObject *)object;
+
+/* Returns the objects whose property value (or its uniqueIdentifier) equals the given value, in registration order. */
+-(NSArray *)objectsWithValue:(id)value;
+
+@end
+
+/* Returns the key an object is filed under in a GRPropertyIndex for the given property value. */
+static id GRPropertyIndexKeyForValue(id value)
+{
+    // Relationships are indexed by the uniqueIdentifier of the related object
+    if ([value respondsToSelector:@selector(uniqueIdentifier)])
+        value = [value uniqueIdentifier];
+
+    // nil values are filed under NSNull
+    return value ?: [NSNull null];
+}
 
 @interface GRSource ()
 
+/* The registered objects. An ordered set keeps registration order while making membership tests and removal constant time. */
+@property (strong, nonatomic) NSMutableOrderedSet *orderedObjects;
+
 /* The observers of the source. */
 @property (strong, nonatomic) NSMutableArray *observers;
+
+/* An index of the source's objects keyed by their uniqueIdentifier. Kept in step with `objects` in registerObject: and deregisterObject:. */
+@property (strong, nonatomic) NSMutableDictionary *objectsByUniqueIdentifier;
+
+/* The GRPropertyIndex for each of the managed class' +indexedProperties, keyed by property name. */
+@property (strong, nonatomic) NSMutableDictionary *propertyIndexes;
+
+/* How many performBatchUpdates: blocks are currently running. Observers are only notified when this is 0. */
+@property (nonatomic) NSUInteger batchDepth;
+
+/* The changes recorded during batch updates, waiting to be sent to observers when the outermost batch ends. */
+@property (strong, nonatomic) GRSourceChangeSet *batchChangeSet;
+
+/* The changes waiting to be sent to observers that implement source:didChangeObjects:. */
+@property (strong, nonatomic) GRSourceChangeSet *pendingChangeSet;
+
+/* The objects that coalesce their changes and have changes waiting to be flushed. */
+@property (strong, nonatomic) NSMutableOrderedSet *dirtyObjects;
+
+/* Whether flushChanges has been scheduled for the end of the run loop turn. */
+@property (nonatomic) BOOL flushScheduled;
+
+/* The uniqueIdentifiers of registered objects that haven't been created yet, in order. */
+@property (strong, nonatomic) NSMutableOrderedSet *faults;
+@end
+
+@interface GRSourceChangeSet ()
+
+/* Adds a change to the set, coalescing it with what the set already knows about the object. */
+-(void)recordChange:(GRObject *)object type:(GRObjectChangeType)change keyPath:(NSString *)keyPath;
+
+/* Records every change in the given set, as if they had happened after the receiver's changes. */
+-(void)addChangesFromChangeSet:(GRSourceChangeSet *)changeSet;
+
 @end
 
 @implementation GRSource
 
 #pragma mark - Initialization
 
++(NSMutableDictionary *)sources
+{
+    // Create the sources dictionary and its queue once, safely, whichever thread gets here first
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sources      = [NSMutableDictionary dictionary];
+        sourcesQueue = dispatch_queue_create("org.thegravytrain.source.registry", DISPATCH_QUEUE_CONCURRENT);
+    });
+
+    return sources;
+}
+
 +(instancetype)source:(Class)managedClass
 {
     // Check that the class argument is provided
     NSParameterAssert(managedClass);
 
     // If a source exists for this class, return it.
-    for (GRSource *source in sources)
-    {
-        // We identify each source with its managedClass property.
-        // A class can only have one source.
-        if (source.managedClass == managedClass)
-            return source;
-    }
+    // We identify each source with its managedClass property. A class can only have one source.
+    GRSource *source = [GRSource registeredSourceForClass:managedClass];
+    if (source)
+        return source;
+
+    // No source for this class, initialize and return one. It's created outside the registry, so it can load its objects (and look up other sources, from any thread) while it initializes. If another thread registered a source for the class first, the initializer returns nil and we return that one.
+    source = [[self alloc] initWithManagedClass:managedClass];
+    return source ?: [GRSource registeredSourceForClass:managedClass];
+}
+
++(GRSource *)registeredSourceForClass:(Class)managedClass
+{
+    NSMutableDictionary *allSources = [GRSource sources];
+
+    __block GRSource *source;
+    dispatch_sync(sourcesQueue, ^{
+        source = allSources[managedClass];
+    });
 
-    // No source for this class, initialize and return one
-    return [[self alloc] initWithManagedClass:managedClass];
+    return source;
+}
+
++(BOOL)registerSource:(GRSource *)source
+{
+    NSMutableDictionary *allSources = [GRSource sources];
+
+    // Check and insert in one step, so only one source is ever registered for a class
+    __block BOOL registered = NO;
+    dispatch_barrier_sync(sourcesQueue, ^{
+        if (allSources[source.managedClass])
+            return;
+
+        allSources[(id<NSCopying>)source.managedClass] = source;
+        registered = YES;
+    });
+
+    return registered;
 }
 
 -(id)initWithManagedClass:(Class)managedClass
@@ -47,16 +152,27 @@ static NSMutableArray *sources = nil;
         // Set the class that identifies the store
         _managedClass = managedClass;
 
-        // Add arrays that hold all the source's objects, collections and bindings. As the source owns its objects, it receives messages when the objects are added, changed or deleted, which it then passes to its collections and bindings.
-        _objects     = [NSMutableArray array];
-        _observers   = [NSMutableArray array];
+        // Add the containers that hold all the source's objects, collections and bindings. As the source owns its objects, it receives messages when the objects are added, changed or deleted, which it then passes to its collections and bindings.
+        _orderedObjects = [NSMutableOrderedSet orderedSet];
+        _observers      = [NSMutableArray array];
+
+        // Index objects by uniqueIdentifier so lookups (eg. resolving relationships during deserialization) don't scan the objects array
+        _objectsByUniqueIdentifier = [NSMutableDictionary dictionary];
 
-        // Create the sources array if it does not exist
-        if (!sources)
-            sources = [NSMutableArray array];
+        // Changes for observers that take change sets are collected here until they're flushed
+        _pendingChangeSet = [[GRSourceChangeSet alloc] init];
+        _dirtyObjects     = [NSMutableOrderedSet orderedSet];
+        _faults           = [NSMutableOrderedSet orderedSet];
 
-        // Add the source to the sources array
-        [sources addObject:self];
+        // Create an index for each property the managed class asks to be indexed
+        _propertyIndexes = [NSMutableDictionary dictionary];
+        if ([managedClass respondsToSelector:@selector(indexedProperties)])
+            for (NSString *property in [managedClass indexedProperties])
+                _propertyIndexes[property] = [[GRPropertyIndex alloc] initWithProperty:property order:_orderedObjects];
+
+        // Add the source to the sources dictionary before subclasses load their objects, so looking up the class' source meanwhile (eg. to resolve a relationship to one of its own objects) finds this one. If another thread registered one first, this source isn't needed.
+        if (![GRSource registerSource:self])
+            return nil;
     }
 
     return self;
@@ -69,8 +185,16 @@ static NSMutableArray *sources = nil;
     // Check that a GRObject of this source's class is being registered
     NSAssert2([object isKindOfClass:self.managedClass], @"Only instances of the source's managed class can be registered with a GRSource. Did you mean to call registerObserver: instead of registerObject:? Source class: %@, given object: %@", NSStringFromClass(self.managedClass), object);
 
+    // Saving an object twice doesn't register it twice
+    if ([self.orderedObjects containsObject:object])
+        return;
+
+    // An object registered in place of a fault replaces it
+    if (object.uniqueIdentifier)
+        [self.faults removeObject:object.uniqueIdentifier];
+
     // Add this object to the store
-    [self.objects addObject:object];
+    [self addObjectToStore:object];
 
     // Notify observers of the new object
     [self notifyObserversOfObjectChange:object type:GRObjectChangeTypeInsert keyPath:nil];
@@ -78,32 +202,410 @@ static NSMutableArray *sources = nil;
 
 -(void)notifyUpdatedObject:(GRObject *)object withChangedKeyPath:(NSString *)changedKeyPath
 {
+    // Move the object to its new bucket if an indexed property changed
+    [self.propertyIndexes[changedKeyPath] updateObject:object];
+
     // Notify observers of the update
     [self notifyObserversOfObjectChange:object type:GRObjectChangeTypeUpdate keyPath:changedKeyPath];
 }
 
+-(void)notifyDirtyObject:(GRObject *)object
+{
+    // Apply the object's changes when the pending changes are flushed
+    [self.dirtyObjects addObject:object];
+    [self scheduleFlush];
+}
+
 -(void)deregisterObject:(GRObject *)object
 {
     // Hold the object so it isn't released while an observer is handling it
     GRObject *objectCache = object;
 
     // Remove this object from the store
-    [self.objects removeObject:object];
+    [self removeObjectFromStore:object];
 
     // Notify observers of removed object
     [self notifyObserversOfObjectChange:objectCache type:GRObjectChangeTypeDelete keyPath:nil];
 }
 
--(void)notifyObserversOfObjectChange:(GRObject *)object type:(GRObjectChangeType)change keyPath:(NSString *)keyPath
+-(void)registerObjects:(NSArray *)objects
+{
+    [self performBatchUpdates:^{
+        for (GRObject *object in objects)
+            [self registerObject:object];
+    }];
+}
+
+-(void)deregisterObjects:(NSArray *)objects
 {
-    // Get the observer by unthawing the NSValue, send it the update message
-    // Create a separate array because observers may want to deregister themselves here and that would cause a "was mutated while being enumerated" exception.
+    [self performBatchUpdates:^{
+        for (GRObject *object in objects)
+        {
+            // Skip objects that aren't registered, so observers only hear about real removals
+            if ([self.orderedObjects containsObject:object])
+                [self deregisterObject:object];
+        }
+    }];
+}
+
+-(void)addObjectToStore:(GRObject *)object
+{
+    // Add this object to the store
+    [self.orderedObjects addObject:object];
+
+    // Index the object by its uniqueIdentifier
+    if (object.uniqueIdentifier)
+        self.objectsByUniqueIdentifier[object.uniqueIdentifier] = object;
+
+    // Add the object to the property indexes
+    for (GRPropertyIndex *index in [self.propertyIndexes allValues])
+        [index addObject:object];
+}
+
+-(void)removeObjectFromStore:(GRObject *)object
+{
+    // Remove this object from the store
+    [self.orderedObjects removeObject:object];
+
+    // Remove it from the index, unless another object has taken its identifier
+    if (object.uniqueIdentifier && self.objectsByUniqueIdentifier[object.uniqueIdentifier] == object)
+        [self.objectsByUniqueIdentifier removeObjectForKey:object.uniqueIdentifier];
+
+    // Remove it from the property indexes
+    for (GRPropertyIndex *index in [self.propertyIndexes allValues])
+        [index removeObject:object];
+}
+
+-(NSArray *)currentObservers
+{
+    // Get the observer by unthawing the NSValue
+    // Create a separate array because observers may want to deregister themselves while being notified and that would cause a "was mutated while being enumerated" exception.
     NSMutableArray *observers = [NSMutableArray array];
     for (NSValue *observerValue in self.observers)
         [observers addObject:[observerValue nonretainedObjectValue]];
 
-    for (id<GRSourceObserver> observer in observers)
-        [observer source:self didUpdateObject:object changeType:change keyPath:keyPath];
+    return observers;
+}
+
+-(void)notifyObserversOfObjectChange:(GRObject *)object type:(GRObjectChangeType)change keyPath:(NSString *)keyPath
+{
+    // During batch updates, record the change to be sent when the batch ends
+    if (self.batchDepth)
+    {
+        [self.batchChangeSet recordChange:object type:change keyPath:keyPath];
+        return;
+    }
+
+    BOOL hasChangeSetObservers = NO;
+    for (id<GRSourceObserver> observer in [self currentObservers])
+    {
+        // Observers that take change sets hear about this when the pending changes are flushed, the others right away
+        if ([observer respondsToSelector:@selector(source:didChangeObjects:)])
+            hasChangeSetObservers = YES;
+        else
+            [observer source:self didUpdateObject:object changeType:change keyPath:keyPath];
+    }
+
+    if (hasChangeSetObservers)
+    {
+        [self.pendingChangeSet recordChange:object type:change keyPath:keyPath];
+        [self scheduleFlush];
+    }
+}
+
+-(void)notifyObserversOfChangeSet:(GRSourceChangeSet *)changeSet
+{
+    BOOL hasChangeSetObservers = NO;
+    for (id<GRSourceObserver> observer in [self currentObservers])
+    {
+        if ([observer respondsToSelector:@selector(source:didChangeObjects:)])
+        {
+            hasChangeSetObservers = YES;
+            continue;
+        }
+
+        // Observers that can handle a batch get one message per type of change, the others get one per object
+        [self notifyObserver:observer ofObjectChanges:[changeSet deletedObjects] type:GRObjectChangeTypeDelete];
+        [self notifyObserver:observer ofObjectChanges:[changeSet insertedObjects] type:GRObjectChangeTypeInsert];
+        [self notifyObserver:observer ofObjectChanges:[changeSet updatedObjects] type:GRObjectChangeTypeUpdate];
+    }
+
+    // Change set observers get the batch as soon as it ends, together with anything else that was pending
+    if (hasChangeSetObservers)
+    {
+        [self.pendingChangeSet addChangesFromChangeSet:changeSet];
+        [self flushChanges];
+    }
+}
+
+-(void)notifyObserver:(id<GRSourceObserver>)observer ofObjectChanges:(NSArray *)objects type:(GRObjectChangeType)change
+{
+    if (![objects count])
+        return;
+
+    if ([observer respondsToSelector:@selector(source:didUpdateObjects:changeType:)])
+        [observer source:self didUpdateObjects:objects changeType:change];
+    else
+        for (GRObject *object in objects)
+            [observer source:self didUpdateObject:object changeType:change keyPath:nil];
+}
+
+#pragma mark - Change sets
+
+-(void)scheduleFlush
+{
+    // Deliver the pending changes once, at the end of this run loop turn
+    if (self.flushScheduled)
+        return;
+
+    self.flushScheduled = YES;
+    [self performSelector:@selector(flushChanges) withObject:nil afterDelay:0];
+}
+
+-(void)flushChanges
+{
+    // If we're flushing early, we don't need the scheduled flush any more
+    if (self.flushScheduled)
+    {
+        [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(flushChanges) object:nil];
+        self.flushScheduled = NO;
+    }
+
+    // Apply the coalesced changes of dirty objects first, so they're part of this change set
+    [self flushDirtyObjects];
+
+    // Take the pending changes before notifying, in case an observer makes more changes
+    GRSourceChangeSet *changeSet = self.pendingChangeSet;
+    self.pendingChangeSet = [[GRSourceChangeSet alloc] init];
+
+    if (![changeSet count])
+        return;
+
+    for (id<GRSourceObserver> observer in [self currentObservers])
+        if ([observer respondsToSelector:@selector(source:didChangeObjects:)])
+            [observer source:self didChangeObjects:changeSet];
+}
+
+-(void)flushDirtyObjects
+{
+    if (![self.dirtyObjects count])
+        return;
+
+    // Take the dirty objects, as flushing may make them dirty again
+    NSArray *dirtyObjects = [self.dirtyObjects array];
+    self.dirtyObjects = [NSMutableOrderedSet orderedSet];
+
+    // All the objects share one updateDate, and observers hear about them in one batch
+    NSDate *updateDate = [NSDate date];
+    [self performBatchUpdates:^{
+        for (GRObject *object in dirtyObjects)
+            [object flushChangesWithUpdateDate:updateDate];
+    }];
+}
+
+#pragma mark - Batch updates
+
+-(void)performBatchUpdates:(void (^)(void))updates
+{
+    // Create the change set for the outermost batch
+    if (!self.batchDepth)
+        self.batchChangeSet = [[GRSourceChangeSet alloc] init];
+
+    self.batchDepth++;
+    @try
+    {
+        updates();
+    }
+    @finally
+    {
+        // Even if the block throws, end the batch and deliver what it changed, or observers would never hear from us again
+        self.batchDepth--;
+
+        // Nested batches are flushed by the outermost one
+        if (!self.batchDepth)
+        {
+            // Take the batch's changes before notifying, in case an observer starts a batch of its own
+            GRSourceChangeSet *changeSet = self.batchChangeSet;
+            self.batchChangeSet = nil;
+
+            if ([changeSet count])
+                [self notifyObserversOfChangeSet:changeSet];
+        }
+    }
+}
+
+#pragma mark - Faults
+
+-(void)registerFaultsWithUniqueIdentifiers:(NSArray *)uniqueIdentifiers
+{
+    [self.faults addObjectsFromArray:uniqueIdentifiers];
+}
+
+-(GRObject *)objectForFaultWithUniqueIdentifier:(NSString *)uniqueIdentifier
+{
+    return nil;
+}
+
+-(NSArray *)faultUniqueIdentifiersWithValue:(id)value forProperty:(NSString *)property
+{
+    // We can't tell without creating the objects
+    return [self.faults array];
+}
+
+-(NSArray *)faultUniqueIdentifiers
+{
+    return [self.faults array];
+}
+
+-(NSArray *)objectsWithoutFiringFaults
+{
+    return [self.orderedObjects array];
+}
+
+-(BOOL)containsObject:(GRObject *)object
+{
+    return [self.orderedObjects containsObject:object];
+}
+
+-(GRObject *)fireFaultWithUniqueIdentifier:(NSString *)uniqueIdentifier
+{
+    // Remove the fault first, so that looking the object up while it's being created (eg. a relationship to itself) doesn't fire it again
+    [self.faults removeObject:uniqueIdentifier];
+
+    // Register the object quietly: observers already consider it part of the source
+    GRObject *object = [self objectForFaultWithUniqueIdentifier:uniqueIdentifier];
+    if (object)
+        [self addObjectToStore:object];
+
+    return object;
+}
+
+-(void)fireAllFaults
+{
+    if (![self.faults count])
+        return;
+
+    // Fire the faults in order, so objects keep their stored order (from a copy, as firing removes them)
+    for (NSString *uniqueIdentifier in [self.faults copy])
+    {
+        @autoreleasepool {
+            if ([self.faults containsObject:uniqueIdentifier])
+                [self fireFaultWithUniqueIdentifier:uniqueIdentifier];
+        }
+    }
+}
+
+-(void)fireFaultsWithValue:(id)value forProperty:(NSString *)property
+{
+    if (![self.faults count])
+        return;
+
+    for (NSString *uniqueIdentifier in [self faultUniqueIdentifiersWithValue:value forProperty:property])
+    {
+        @autoreleasepool {
+            if ([self.faults containsObject:uniqueIdentifier])
+                [self fireFaultWithUniqueIdentifier:uniqueIdentifier];
+        }
+    }
+}
+
+#pragma mark - Retrieving objects
+
+-(NSArray *)objects
+{
+    // Every object is needed
+    [self fireAllFaults];
+
+    // A snapshot, so callers can save or remove objects while they iterate it
+    return [[self.orderedObjects array] copy];
+}
+
+-(GRObject *)objectWithUniqueIdentifier:(NSString *)uniqueIdentifier
+{
+    if (!uniqueIdentifier)
+        return nil;
+
+    GRObject *object = self.objectsByUniqueIdentifier[uniqueIdentifier];
+    if (!object && [self.faults containsObject:uniqueIdentifier])
+        object = [self fireFaultWithUniqueIdentifier:uniqueIdentifier];
+
+    return object;
+}
+
+-(NSArray *)objectsWithValue:(id)value forProperty:(NSString *)property
+{
+    // Probe the index if there is one, once the faults that might match have fired. Objects that coalesce their changes are only moved to their new buckets when they're flushed, so flush them first.
+    GRPropertyIndex *index = self.propertyIndexes[property];
+    if (index)
+    {
+        [self flushDirtyObjects];
+        [self fireFaultsWithValue:value forProperty:property];
+        return [index objectsWithValue:value];
+    }
+
+    // Otherwise fall back to scanning every object, comparing the same way the index would
+    id key = GRPropertyIndexKeyForValue(value);
+    NSPredicate *predicate = [NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary *bindings) {
+        return [GRPropertyIndexKeyForValue([object valueForKey:property]) isEqual:key];
+    }];
+    return [self.objects filteredArrayUsingPredicate:predicate];
+}
+
+-(NSArray *)objectsMatchingPredicate:(NSPredicate *)predicate
+{
+    if (!predicate)
+        return self.objects;
+
+    // If the predicate (or one of the terms of an AND predicate) is an equality test on an indexed property, use the index to narrow down the candidates before filtering (only the faults among them fire). Otherwise every object's values are needed.
+    NSArray *candidates = [self indexedCandidatesForPredicate:predicate];
+    if (!candidates)
+        candidates = self.objects;
+
+    return [candidates filteredArrayUsingPredicate:predicate];
+}
+
+-(NSArray *)indexedCandidatesForPredicate:(NSPredicate *)predicate
+{
+    if ([predicate isKindOfClass:[NSCompoundPredicate class]])
+    {
+        // Every object matching an AND predicate matches each of its terms, so any indexable term gives us a candidate set
+        NSCompoundPredicate *compoundPredicate = (NSCompoundPredicate *)predicate;
+        if ([compoundPredicate compoundPredicateType] != NSAndPredicateType)
+            return nil;
+
+        for (NSPredicate *subpredicate in [compoundPredicate subpredicates])
+        {
+            NSArray *candidates = [self indexedCandidatesForPredicate:subpredicate];
+            if (candidates)
+                return candidates;
+        }
+
+        return nil;
+    }
+
+    if (![predicate isKindOfClass:[NSComparisonPredicate class]])
+        return nil;
+
+    // We can only use an index for a plain, case-sensitive `keyPath == constant`
+    NSComparisonPredicate *comparisonPredicate = (NSComparisonPredicate *)predicate;
+    if ([comparisonPredicate predicateOperatorType] != NSEqualToPredicateOperatorType ||
+        [comparisonPredicate comparisonPredicateModifier] != NSDirectPredicateModifier ||
+        [comparisonPredicate options] != 0 ||
+        [[comparisonPredicate leftExpression] expressionType] != NSKeyPathExpressionType ||
+        [[comparisonPredicate rightExpression] expressionType] != NSConstantValueExpressionType)
+        return nil;
+
+    // Either `property == value` or `property.uniqueIdentifier == value` can be answered by the index on `property`
+    NSString *keyPath = [[comparisonPredicate leftExpression] keyPath];
+    NSString *uniqueIdentifierSuffix = @".uniqueIdentifier";
+    if ([keyPath hasSuffix:uniqueIdentifierSuffix])
+        keyPath = [keyPath substringToIndex:[keyPath length] - [uniqueIdentifierSuffix length]];
+
+    GRPropertyIndex *index = self.propertyIndexes[keyPath];
+    if (!index)
+        return nil;
+
+    return [self objectsWithValue:[[comparisonPredicate rightExpression] constantValue] forProperty:keyPath];
 }
 
 #pragma mark - Observer notifications
@@ -121,3 +623,229 @@ static NSMutableArray *sources = nil;
 }
 
 @end
+
+#pragma mark - Change set
+
+@interface GRSourceChangeSet ()
+
+@property (strong, nonatomic) NSMutableOrderedSet *inserted;
+@property (strong, nonatomic) NSMutableOrderedSet *updated;
+@property (strong, nonatomic) NSMutableOrderedSet *deleted;
+
+/* The changed keypaths of each updated object. Keys are compared by pointer. */
+@property (strong, nonatomic) NSMapTable *keyPathsByObject;
+
+@end
+
+@implementation GRSourceChangeSet
+
+-(id)init
+{
+    if (self = [super init])
+    {
+        _inserted         = [NSMutableOrderedSet orderedSet];
+        _updated          = [NSMutableOrderedSet orderedSet];
+        _deleted          = [NSMutableOrderedSet orderedSet];
+        _keyPathsByObject = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                                  valueOptions:NSPointerFunctionsStrongMemory];
+    }
+
+    return self;
+}
+
+-(NSArray *)insertedObjects
+{
+    return [self.inserted array];
+}
+
+-(NSArray *)updatedObjects
+{
+    return [self.updated array];
+}
+
+-(NSArray *)deletedObjects
+{
+    return [self.deleted array];
+}
+
+-(NSSet *)changedKeyPathsForObject:(GRObject *)object
+{
+    return [[self.keyPathsByObject objectForKey:object] copy] ?: [NSSet set];
+}
+
+-(NSUInteger)count
+{
+    return [self.inserted count] + [self.updated count] + [self.deleted count];
+}
+
+-(void)recordChange:(GRObject *)object type:(GRObjectChangeType)change keyPath:(NSString *)keyPath
+{
+    // Coalesce the change with what we already know about the object, so observers see each object at most once, with its net change
+    switch (change)
+    {
+        case GRObjectChangeTypeInsert:
+            // Deleted then re-inserted is, from the outside, an update
+            if ([self.deleted containsObject:object])
+            {
+                [self.deleted removeObject:object];
+                [self.updated addObject:object];
+            }
+            else
+                [self.inserted addObject:object];
+            break;
+
+        case GRObjectChangeTypeUpdate:
+            // Updates to an object inserted in this set are part of the insert, and deleted objects have no updates to speak of
+            if ([self.inserted containsObject:object] || [self.deleted containsObject:object])
+                break;
+
+            [self.updated addObject:object];
+            if (keyPath)
+            {
+                NSMutableSet *keyPaths = [self.keyPathsByObject objectForKey:object];
+                if (!keyPaths)
+                {
+                    keyPaths = [NSMutableSet set];
+                    [self.keyPathsByObject setObject:keyPaths forKey:object];
+                }
+                [keyPaths addObject:keyPath];
+            }
+            break;
+
+        case GRObjectChangeTypeDelete:
+            // Inserted then deleted means observers never need to hear about it
+            if ([self.inserted containsObject:object])
+                [self.inserted removeObject:object];
+            else
+            {
+                [self.updated removeObject:object];
+                [self.keyPathsByObject removeObjectForKey:object];
+                [self.deleted addObject:object];
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+-(void)addChangesFromChangeSet:(GRSourceChangeSet *)changeSet
+{
+    for (GRObject *object in changeSet.deleted)
+        [self recordChange:object type:GRObjectChangeTypeDelete keyPath:nil];
+
+    for (GRObject *object in changeSet.inserted)
+        [self recordChange:object type:GRObjectChangeTypeInsert keyPath:nil];
+
+    for (GRObject *object in changeSet.updated)
+    {
+        // Keep the keypaths of the update; an update without any is still an update
+        NSSet *keyPaths = [changeSet.keyPathsByObject objectForKey:object];
+        [self recordChange:object type:GRObjectChangeTypeUpdate keyPath:nil];
+        for (NSString *keyPath in keyPaths)
+            [self recordChange:object type:GRObjectChangeTypeUpdate keyPath:keyPath];
+    }
+}
+
+-(NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ (%lu inserted, %lu updated, %lu deleted)",
+            NSStringFromClass([self class]), (unsigned long)[self.inserted count], (unsigned long)[self.updated count], (unsigned long)[self.deleted count]];
+}
+
+@end
+
+#pragma mark - Property index
+
+@interface GRPropertyIndex ()
+
+/* The source's registered objects, in registration order. */
+@property (strong, nonatomic) NSOrderedSet *order;
+
+/* Buckets of objects, keyed by index key. Each bucket is an ordered set in registration order, so objects can be removed from large buckets (eg. NSNull) in constant time. */
+@property (strong, nonatomic) NSMutableDictionary *buckets;
+
+/* The index key each object was last filed under, so it can be found again after its property changes. Keys are compared by pointer. */
+@property (strong, nonatomic) NSMapTable *keysByObject;
+
+@end
+
+@implementation GRPropertyIndex
+
+-(id)initWithProperty:(NSString *)property order:(NSOrderedSet *)order
+{
+    if (self = [super init])
+    {
+        _property     = property;
+        _order        = order;
+        _buckets      = [NSMutableDictionary dictionary];
+        _keysByObject = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                              valueOptions:NSPointerFunctionsStrongMemory];
+    }
+
+    return self;
+}
+
+-(void)addObject:(GRObject *)object
+{
+    id key = GRPropertyIndexKeyForValue([object valueForKey:self.property]);
+
+    NSMutableOrderedSet *bucket = self.buckets[key];
+    if (!bucket)
+    {
+        bucket = [NSMutableOrderedSet orderedSet];
+        self.buckets[key] = bucket;
+    }
+
+    // Newly registered objects go at the end. Objects moving between buckets are put back in registration order.
+    NSOrderedSet *order = self.order;
+    NSUInteger position = [order indexOfObject:object];
+    if (![bucket count] || position == NSNotFound || [order indexOfObject:[bucket lastObject]] < position)
+        [bucket addObject:object];
+    else
+    {
+        NSUInteger index = [bucket indexOfObject:object inSortedRange:NSMakeRange(0, [bucket count]) options:NSBinarySearchingInsertionIndex usingComparator:^NSComparisonResult(id a, id b) {
+            NSUInteger positionA = [order indexOfObject:a], positionB = [order indexOfObject:b];
+            return positionA < positionB ? NSOrderedAscending : (positionA > positionB ? NSOrderedDescending : NSOrderedSame);
+        }];
+        [bucket insertObject:object atIndex:index];
+    }
+
+    [self.keysByObject setObject:key forKey:object];
+}
+
+-(void)updateObject:(GRObject *)object
+{
+    // Objects that aren't in the index (ie. not registered with the source) are left out
+    id oldKey = [self.keysByObject objectForKey:object];
+    if (!oldKey)
+        return;
+
+    // Nothing to do if the object stays in the same bucket
+    if ([oldKey isEqual:GRPropertyIndexKeyForValue([object valueForKey:self.property])])
+        return;
+
+    [self removeObject:object];
+    [self addObject:object];
+}
+
+-(void)removeObject:(GRObject *)object
+{
+    id key = [self.keysByObject objectForKey:object];
+    if (!key)
+        return;
+
+    NSMutableOrderedSet *bucket = self.buckets[key];
+    [bucket removeObject:object];
+    if (![bucket count])
+        [self.buckets removeObjectForKey:key];
+
+    [self.keysByObject removeObjectForKey:object];
+}
+
+-(NSArray *)objectsWithValue:(id)value
+{
+    return [[self.buckets[GRPropertyIndexKeyForValue(value)] array] copy] ?: @[];
+}
+
+@end
@@ -8,6 +8,29 @@
 
 #import <Foundation/Foundation.h>
 
+/* GRPropertyMetadata describes one property of a class: everything the runtime can tell us about it, parsed once. */
+@interface GRPropertyMetadata : NSObject
+
+/* The name of the property. */
+@property (strong, nonatomic, readonly) NSString *name;
+
+/* The class name for object properties (or "id"), or the type encoding for primitives, as returned by `+classProperties`. */
+@property (strong, nonatomic, readonly) NSString *type;
+
+/* The class of object properties, or Nil for primitives and `id` properties. */
+@property (strong, nonatomic, readonly) Class propertyClass;
+
+/* The getter of the property. */
+@property (nonatomic, readonly) SEL getter;
+
+/* The setter of the property, or NULL if it is readonly. */
+@property (nonatomic, readonly) SEL setter;
+
+/* The offset of the property's backing instance variable, or -1 if it has none (eg. dynamic properties). */
+@property (nonatomic, readonly) ptrdiff_t ivarOffset;
+
+@end
+
 /* This category on NSObject implements three powerful methods using introspective language features of Objective C and the Objective C runtime to enable most of GRSerialization's wizardry. */
 
 @interface NSObject (GRIntrospection)
@@ -16,11 +39,17 @@
  */
 +(NSDictionary *)classProperties;
 
+/* Returns a GRPropertyMetadata for each public property of the class and its superclasses. Like the other introspection methods, this is worked out once per class and cached for the life of the process, and can be called from any thread. */
++(NSArray *)classPropertyMetadata;
+
+/* Returns the GRPropertyMetadata for the property with the given name, or nil if the class has no such property. */
++(GRPropertyMetadata *)metadataForProperty:(NSString *)property;
+
 /* Returns an NSArray of all public property names of the receiving class that match the given type. If nil, it returns the name of every public property. Primitive types use the values explained in the Objective C Runtime Programming Guide. https://developer.apple.com/library/mac/#documentation/Cocoa/Conceptual/ObjCRuntimeGuide/Articles/ocrtTypeEncodings.html
  */
 +(NSArray *)propertiesOfType:(NSString *)type;
 
-/* Returns an NSArray of every subclass of the receiving class registered with the runtime. */
+/* Returns an NSArray of every subclass of the receiving class registered with the runtime. The runtime is only scanned the first time this is called for a class. The result is cached until a bundle is loaded. */
 +(NSArray *)subclasses;
 
 @end
@@ -9,20 +9,157 @@
 #import "NSObject+GRIntrospection.h"
 #import <objc/runtime.h>
 
+/* The introspection cache, keyed by class. Each entry holds the class' property metadata in a few shapes, computed once. */
+static NSMutableDictionary *classMetadataCache = nil;
+
+static NSString * const GRClassMetadataPropertiesKey = @"properties";
+static NSString * const GRClassMetadataPropertiesByNameKey = @"propertiesByName";
+static NSString * const GRClassMetadataPropertyTypesKey = @"propertyTypes";
+static NSString * const GRClassMetadataPropertyNamesKey = @"propertyNames";
+
+/* The subclasses of each class that has been asked for them, keyed by class. Emptied whenever a bundle is loaded, as that can add classes. */
+static NSMutableDictionary *subclassesCache = nil;
+
+static NSString * gravy_getPropertyType(objc_property_t property);
+NSArray *gravy_getSubclasses(Class parentClass);
+
+#pragma mark - Property metadata
+
+@interface GRPropertyMetadata ()
+
+-(id)initWithProperty:(objc_property_t)property ofClass:(Class)klass;
+
+@end
+
+@implementation GRPropertyMetadata
+
+-(id)initWithProperty:(objc_property_t)property ofClass:(Class)klass
+{
+    if (self = [super init])
+    {
+        _name          = @(property_getName(property));
+        _type          = gravy_getPropertyType(property);
+        _propertyClass = NSClassFromString(_type);
+
+        // Getter: custom or the property name
+        char *getter = property_copyAttributeValue(property, "G");
+        _getter = getter ? sel_registerName(getter) : NSSelectorFromString(_name);
+        free(getter);
+
+        // Setter: none if readonly, custom or setProperty:
+        char *readonly = property_copyAttributeValue(property, "R");
+        char *setter   = property_copyAttributeValue(property, "S");
+        if (readonly)
+            _setter = NULL;
+        else if (setter)
+            _setter = sel_registerName(setter);
+        else if ([_name length])
+            _setter = NSSelectorFromString([NSString stringWithFormat:@"set%@%@:", [[_name substringToIndex:1] uppercaseString], [_name substringFromIndex:1]]);
+        free(readonly);
+        free(setter);
+
+        // Backing instance variable, if any
+        _ivarOffset = -1;
+        char *ivarName = property_copyAttributeValue(property, "V");
+        if (ivarName)
+        {
+            Ivar ivar = class_getInstanceVariable(klass, ivarName);
+            if (ivar)
+                _ivarOffset = ivar_getOffset(ivar);
+            free(ivarName);
+        }
+    }
+
+    return self;
+}
+
+-(NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ (%@)", self.name, self.type];
+}
+
+@end
+
 #pragma mark - Introspection
 
 @implementation NSObject (GRIntrospection)
 
++(NSDictionary *)classMetadata
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        classMetadataCache = [NSMutableDictionary dictionary];
+    });
+
+    @synchronized(classMetadataCache)
+    {
+        // Return the cached metadata if we've seen this class before
+        NSDictionary *classMetadata = classMetadataCache[self];
+        if (classMetadata)
+            return classMetadata;
+
+        NSMutableArray *properties            = [NSMutableArray array];
+        NSMutableDictionary *propertiesByName = [NSMutableDictionary dictionary];
+        NSMutableDictionary *propertyTypes    = [NSMutableDictionary dictionary];
+
+        // We need to iterate through all classes up to, but not including, NSObject
+        Class klass = self;
+        while (klass && klass != [NSObject class])
+        {
+            // Get property list
+            unsigned int outCount, i;
+            objc_property_t *propertyList = class_copyPropertyList(klass, &outCount);
+            for (i = 0; i < outCount; i++)
+            {
+                // Subclasses that redeclare a property take precedence over their superclasses
+                const char *propertyName = property_getName(propertyList[i]);
+                if (!propertyName || propertiesByName[@(propertyName)])
+                    continue;
+
+                GRPropertyMetadata *metadata = [[GRPropertyMetadata alloc] initWithProperty:propertyList[i] ofClass:klass];
+                [properties addObject:metadata];
+                propertiesByName[metadata.name] = metadata;
+                propertyTypes[metadata.name]    = metadata.type;
+            }
+            free(propertyList);
+
+            // Go up a class
+            klass = [klass superclass];
+        }
+
+        classMetadata = @{ GRClassMetadataPropertiesKey:       [properties copy],
+                           GRClassMetadataPropertiesByNameKey: [propertiesByName copy],
+                           GRClassMetadataPropertyTypesKey:    [propertyTypes copy],
+                           GRClassMetadataPropertyNamesKey:    [properties valueForKey:@"name"] };
+        classMetadataCache[(id<NSCopying>)self] = classMetadata;
+
+        return classMetadata;
+    }
+}
+
++(NSArray *)classPropertyMetadata
+{
+    return [self classMetadata][GRClassMetadataPropertiesKey];
+}
+
++(GRPropertyMetadata *)metadataForProperty:(NSString *)property
+{
+    return [self classMetadata][GRClassMetadataPropertiesByNameKey][property];
+}
+
 +(NSArray *)propertiesOfType:(NSString *)type
 {
+    // Every property name is cached already
+    if (!type)
+        return [self classMetadata][GRClassMetadataPropertyNamesKey];
+
     // Get an array of all of the class' properties that match the given type
     // The type string is based on NSStringFromClass() for classes and @encode() value for primitives
-    NSDictionary *propertyList = [self classProperties];
     NSMutableArray *propertiesOfType = [NSMutableArray array];
-    for (NSString *property in propertyList)
+    for (GRPropertyMetadata *metadata in [self classPropertyMetadata])
     {
-        if (!type || [[propertyList valueForKey:property] isEqualToString:type])
-            [propertiesOfType addObject:property];
+        if ([metadata.type isEqualToString:type])
+            [propertiesOfType addObject:metadata.name];
     }
 
     return [propertiesOfType copy];
@@ -30,40 +167,40 @@
 
 +(NSDictionary *)classProperties
 {
-    // Create a dictionary to represent the class' properties like so: { property: type, property: type  }
-    NSMutableDictionary *classProperties = [NSMutableDictionary dictionary];
+    // A dictionary representing the class' properties like so: { property: type, property: type  }
+    return [self classMetadata][GRClassMetadataPropertyTypesKey];
+}
+
++(NSArray *)subclasses
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        subclassesCache = [NSMutableDictionary dictionary];
 
-    // We need to iterate through all classes up to, but not including, NSObject
-    Class klass = self;
-    while (klass != [NSObject class])
+        // Loading a bundle can register new classes, so forget what we know when that happens
+        [[NSNotificationCenter defaultCenter] addObserverForName:NSBundleDidLoadNotification object:nil queue:nil usingBlock:^(NSNotification *notification) {
+            @synchronized(subclassesCache)
+            {
+                [subclassesCache removeAllObjects];
+            }
+        }];
+    });
+
+    @synchronized(subclassesCache)
     {
-        // Get property list
-        unsigned int outCount, i;
-        objc_property_t *properties = class_copyPropertyList(klass, &outCount);
-        for (i = 0; i < outCount; i++)
+        // Scanning the runtime is expensive, so we only do it once per class
+        NSArray *subclasses = subclassesCache[self];
+        if (!subclasses)
         {
-            // Get property name and type and set on classProperties dictionary
-            objc_property_t property = properties[i];
-            const char *propertyName = property_getName(property);
-            if(propertyName)
-                [classProperties setObject:@(gravy_getPropertyType(property)) forKey:@(propertyName)];
+            subclasses = gravy_getSubclasses([self class]);
+            subclassesCache[(id<NSCopying>)self] = subclasses;
         }
-        free(properties);
 
-        // Go up a class
-        klass = [klass superclass];
+        return subclasses;
     }
-
-    // Return immutable dictionary
-    return [classProperties copy];
-}
-
-+(NSArray *)subclasses
-{
-    return gravy_getSubclasses([self class]);
 }
 
-static const char * gravy_getPropertyType(objc_property_t property)
+static NSString * gravy_getPropertyType(objc_property_t property)
 {
     // Given a property, what is its type?
     const char *attributes = property_getAttributes(property);
@@ -75,21 +212,21 @@ static const char * gravy_getPropertyType(objc_property_t property)
         if (attribute[0] == 'T' && attribute[1] != '@')
         {
             // C primitive type:
-            return (const char *)[[NSData dataWithBytes:(attribute + 1) length:strlen(attribute) - 1] bytes];
+            return [[NSString alloc] initWithBytes:(attribute + 1) length:strlen(attribute) - 1 encoding:NSUTF8StringEncoding];
         }
         else if (attribute[0] == 'T' && attribute[1] == '@' && strlen(attribute) == 2)
         {
             // ObjC id type:
-            return "id";
+            return @"id";
         }
         else if (attribute[0] == 'T' && attribute[1] == '@' && attribute[2] != '?')
         {
             // Another ObjC object type:
-            return (const char *)[[NSData dataWithBytes:(attribute + 3) length:strlen(attribute) - 4] bytes];
+            return [[NSString alloc] initWithBytes:(attribute + 3) length:strlen(attribute) - 4 encoding:NSUTF8StringEncoding];
         }
     }
 
-    return "";
+    return @"";
 }
 
 NSArray *gravy_getSubclasses(Class parentClass)